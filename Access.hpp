@@ -0,0 +1,42 @@
+#ifndef ACCESS_HPP
+#define ACCESS_HPP
+
+#include <vector>
+
+// What a stage of an update (an affector, a finalizer) reads and writes, so that a Scheduler can tell which
+// stages may run at the same time: two stages conflict if one writes something the other reads or writes.
+// Attributes belong to the particles of the stage's own system; state is anything else stages share, named by
+// its address. The address of a ParticleSystem as state stands for all of that system, e.g. for an affector
+// that reads another system's particles.
+namespace sched
+{
+    struct Resource
+    {
+        const void* key;
+        bool attribute;     //of the system's particles, otherwise shared state
+    };
+
+    //a member of the particles, e.g. sched::attribute<&PGreen::position>()
+    template <auto Member>
+    Resource attribute()
+    {
+        static const char tag = 0;
+        return {&tag, true};
+    }
+
+    //state shared with other stages, of this system or others
+    inline Resource state(const void* address)
+    {
+        return {address, false};
+    }
+
+    // Stages that don't declare anything touch all of their own system (and its captured state), but nothing
+    // of other systems: an affector that shares state with another system's stages has to declare it.
+    struct Access
+    {
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+    };
+}
+
+#endif
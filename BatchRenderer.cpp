@@ -0,0 +1,152 @@
+#include "BatchRenderer.hpp"
+
+#include <SFML/Graphics/Image.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    unsigned nextPowerOfTwo(unsigned value)
+    {
+        unsigned power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+}
+
+void BatchRenderer::clear()
+{
+    mEntries.clear();
+    mRects.clear();
+    mBuilt = false;
+}
+
+void BatchRenderer::build()
+{
+    pack();
+}
+
+void BatchRenderer::pack() const
+{
+    //every texture once, tallest first, onto shelves of a power-of-two wide atlas
+    mRects.clear();
+    std::vector<std::pair<const sf::Texture*, sf::Image>> images;
+    for (Entry const& entry : mEntries)
+    {
+        if (!entry.texture)
+            continue;
+        const bool known = std::any_of(images.begin(), images.end(), [&entry](auto const& image) { return image.first == entry.texture; });
+        if (!known)
+            images.emplace_back(entry.texture, entry.texture->copyToImage());
+    }
+    std::stable_sort(images.begin(), images.end(), [](auto const& a, auto const& b) { return a.second.getSize().y > b.second.getSize().y; });
+
+    unsigned area = (kWhite + kPadding) * (kWhite + kPadding);
+    unsigned widest = kWhite + kPadding;
+    for (auto const& image : images)
+    {
+        area += (image.second.getSize().x + kPadding) * (image.second.getSize().y + kPadding);
+        widest = std::max(widest, image.second.getSize().x + kPadding);
+    }
+    const unsigned width = nextPowerOfTwo(std::max(widest, static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(area))))));
+
+    //white block first, at the origin
+    std::vector<sf::Vector2u> places;
+    unsigned x = kWhite + kPadding, y = 0, shelf = kWhite + kPadding;
+    for (auto const& image : images)
+    {
+        const sf::Vector2u size = image.second.getSize();
+        if (x + size.x > width)
+        {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        places.push_back({x, y});
+        x += size.x + kPadding;
+        shelf = std::max(shelf, size.y + kPadding);
+    }
+    const unsigned height = nextPowerOfTwo(y + shelf);
+
+    sf::Image atlas;
+    atlas.create(width, height, sf::Color::Transparent);
+    for (unsigned i = 0; i < kWhite; ++i)
+        for (unsigned j = 0; j < kWhite; ++j)
+            atlas.setPixel(i, j, sf::Color::White);
+    for (std::size_t i = 0; i < images.size(); ++i)
+    {
+        atlas.copy(images[i].second, places[i].x, places[i].y);
+        const sf::Vector2u size = images[i].second.getSize();
+        mRects.push_back({images[i].first, sf::FloatRect(static_cast<float>(places[i].x), static_cast<float>(places[i].y),
+                                                         static_cast<float>(size.x), static_cast<float>(size.y))});
+    }
+    mAtlas.loadFromImage(atlas);
+    mBuilt = true;
+}
+
+const sf::Texture& BatchRenderer::getAtlas() const
+{
+    return mAtlas;
+}
+
+sf::FloatRect BatchRenderer::getAtlasRect(const sf::Texture* texture) const
+{
+    for (auto const& rect : mRects)
+        if (rect.first == texture)
+            return rect.second;
+    return sf::FloatRect();
+}
+
+std::size_t BatchRenderer::getDrawCalls() const
+{
+    return mDrawCalls;
+}
+
+void BatchRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) const
+{
+    if (!mBuilt)
+        pack();
+
+    const sf::FloatRect world = target.getView().getInverseTransform().transformRect({-1.f, -1.f, 2.f, 2.f});
+    const sf::FloatRect view = states.transform.getInverse().transformRect(world);
+    for (Entry const& entry : mEntries)
+        entry.cull(view);
+
+    states.texture = &mAtlas;
+    mDrawCalls = 0;
+    std::vector<bool> drawn(mEntries.size(), false);
+    for (std::size_t first = 0; first < mEntries.size(); ++first)
+    {
+        if (drawn[first])
+            continue;
+        const sf::BlendMode mode = mEntries[first].blendMode();
+        mVertices.clear();
+        for (std::size_t i = first; i < mEntries.size(); ++i)
+        {
+            Entry const& entry = mEntries[i];
+            if (drawn[i] || !(entry.blendMode() == mode))
+                continue;
+            drawn[i] = true;
+            const sf::VertexArray& vertices = entry.vertices();
+            const std::size_t count = vertices.getVertexCount();
+            const sf::FloatRect rect = getAtlasRect(entry.texture);
+            const sf::Vector2f offset(rect.left, rect.top);
+            const std::size_t start = mVertices.size();
+            mVertices.resize(start + count);
+            for (std::size_t v = 0; v < count; ++v)
+            {
+                sf::Vertex vertex = vertices[v];
+                //untextured quads all sample the middle of the white block
+                vertex.texCoords = entry.texture ? vertex.texCoords + offset : sf::Vector2f(kWhite / 2.f, kWhite / 2.f);
+                mVertices[start + v] = vertex;
+            }
+        }
+        if (mVertices.empty())
+            continue;
+        states.blendMode = mode;
+        target.draw(mVertices.data(), mVertices.size(), sf::Quads, states);
+        ++mDrawCalls;
+    }
+}
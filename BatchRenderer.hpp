@@ -0,0 +1,74 @@
+#ifndef BATCHRENDERER_HPP
+#define BATCHRENDERER_HPP
+
+#include "ParticleSystem.hpp"
+
+#include <SFML/Graphics/BlendMode.hpp>
+#include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Draws any number of ParticleSystems with one draw call per blend mode.
+// The textures of all added systems are packed into a single atlas (each texture once, however many systems
+// share it, plus a white block for untextured systems); every system's quads are moved to its texture's place
+// in the atlas and appended to the stream of its blend mode. Streams are drawn in the order their blend mode
+// first appears among the added systems, so systems only keep their relative order within a blend mode.
+// Systems are culled against the target's view like in their own draw(), if they have culling on.
+class BatchRenderer : public sf::Drawable
+{
+public:
+    template <typename ParticleType, typename Storage>
+    void add(ParticleSystem<ParticleType, Storage>& system);
+    void clear();
+
+    //packs the atlas again, e.g. after a texture changed; draw() does it by itself after add()
+    void build();
+    const sf::Texture& getAtlas() const;
+    //where a texture ended up in the atlas, or an empty rect if it isn't in there
+    sf::FloatRect getAtlasRect(const sf::Texture* texture) const;
+    //draw calls issued by the last draw()
+    std::size_t getDrawCalls() const;
+private:
+    struct Entry
+    {
+        const sf::Texture* texture;
+        std::function<const sf::VertexArray&()> vertices;
+        std::function<void(sf::FloatRect)> cull;
+        std::function<sf::BlendMode()> blendMode;
+    };
+private:
+    void pack() const;
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+private:
+    static constexpr unsigned kPadding = 1;
+    static constexpr unsigned kWhite = 4;  //side of the white block untextured quads sample from
+    std::vector<Entry> mEntries;
+    mutable std::vector<std::pair<const sf::Texture*, sf::FloatRect>> mRects;
+    mutable sf::Texture mAtlas;
+    mutable bool mBuilt = false;
+    mutable std::vector<sf::Vertex> mVertices;
+    mutable std::size_t mDrawCalls = 0;
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename Storage>
+void BatchRenderer::add(ParticleSystem<ParticleType, Storage>& system)
+{
+    Entry entry;
+    entry.texture = system.getTexture();
+    entry.vertices = [&system]() -> const sf::VertexArray& { return system.getVertices(); };
+    entry.cull = [&system](sf::FloatRect rect) { system.setCullRect(rect); };
+    entry.blendMode = [&system]() { return system.getBlendMode(); };
+    mEntries.push_back(entry);
+    mBuilt = false;
+}
+
+#endif
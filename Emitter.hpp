@@ -5,96 +5,266 @@
 #include <SFML/System/Time.hpp>
 
 #include "Particle.hpp"
+#include "Random.hpp"
 #include "ParticleSystem.hpp"
+#include "Stats.hpp"
 
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <vector>
 
 
-template <typename ParticleType = BaseParticle , typename InheritFrom = sf::Transformable>
+template <typename ParticleType = BaseParticle<>, typename InheritFrom = sf::Transformable, typename Storage = storage::AoS>
 class Emitter : public InheritFrom
 {
+public:
+    using System = ParticleSystem<ParticleType, Storage>;
+    //every particle emitted by one update(), see ParticleSystem::Chunk
+    using Chunk = typename System::Chunk;
 public:
     explicit Emitter(ParticleType defaultParticle);
 public:
     void update(sf::Time dt);
     void setDefaultParticle(ParticleType defaultParticle);
+    ParticleType getDefaultParticle() const;
     void setEmissionRate(float rate);
     float getEmissionRate() const;
-    void addModifier(std::function<void(ParticleType&, Emitter<ParticleType>*)> modifier);
-    void setParticleSystem(ParticleSystem<ParticleType>* system);
+    //time carried over towards the next particle
+    void setAccumulatedTime(sf::Time time);
+    sf::Time getAccumulatedTime() const;
+    void addModifier(std::function<void(ParticleType&, Emitter*)> modifier);
+    void addBatchModifier(std::function<void(Chunk, Emitter*)> modifier);
+    void setParticleSystem(ParticleSystem<ParticleType, Storage>* system);
+    //emits count particles at the position of every event, all in one batch
+    template <typename Event>
+    void emitAt(const std::vector<Event>& events, std::size_t count);
+    //makes this a sub-emitter: emitAt() every particle of parent that dies, or is born. The emitter's system has to be
+    //set before, and stay the same: a Scheduler orders it after parent as it was when the listener was added.
+    //Without a system nothing is added to parent and they return false
+    template <typename ParentType, typename ParentStorage>
+    bool emitOnDeath(ParticleSystem<ParentType, ParentStorage>& parent, std::size_t count);
+    template <typename ParentType, typename ParentStorage>
+    bool emitOnSpawn(ParticleSystem<ParentType, ParentStorage>& parent, std::size_t count);
+    //the emitter's own generator for its modifiers; reseeding it makes the emission reproducible
+    Rng& getRng();
+    const Rng& getRng() const;
+    void seed(std::uint64_t seed);
+    const EmitterStats& getStats() const;
 private:
     void emitParticles(sf::Time dt);
+    void modify(Chunk newborn);
 private:
     float mParticlesPerSecond = 300.f;
-    ParticleSystem<ParticleType>* mParticleSystem;
-    std::vector<std::function<void(ParticleType&, Emitter<ParticleType>*)>> mParticleModifiers;
+    ParticleSystem<ParticleType, Storage>* mParticleSystem;
+    std::vector<std::function<void(ParticleType&, Emitter*)>> mParticleModifiers;
+    std::vector<std::function<void(Chunk, Emitter*)>> mBatchModifiers;
     sf::Time mAccumulatedTime;
     ParticleType mDefaultParticle;
+    Rng mRng;
+    EmitterStats mStats;
 };
 
-template<typename ParticleType, typename InheritFrom>
-Emitter<ParticleType, InheritFrom>::Emitter(ParticleType defaultParticle)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+Emitter<ParticleType, InheritFrom, Storage>::Emitter(ParticleType defaultParticle)
 : mParticleSystem(nullptr)
 , mParticleModifiers()
+, mBatchModifiers()
 , mAccumulatedTime(sf::Time::Zero)
 , mDefaultParticle(defaultParticle)
+, mRng(rng::make())
 {
 
 }
 
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::setDefaultParticle(ParticleType defaultParticle)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::setDefaultParticle(ParticleType defaultParticle)
 {
     mDefaultParticle = defaultParticle;
 }
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::emitParticles(sf::Time dt)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+ParticleType Emitter<ParticleType, InheritFrom, Storage>::getDefaultParticle() const
+{
+    return mDefaultParticle;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::emitParticles(sf::Time dt)
 {
-    sf::Time timeInterval = sf::seconds(1.f)/mParticlesPerSecond;
+    const std::int64_t start = stats::now();
+    std::size_t emitted = 0;
 
     mAccumulatedTime += dt;
-    
-    ParticleType particle(mDefaultParticle);
-    while(mAccumulatedTime > timeInterval)
+
+    //one particle is due for every whole interval in the accumulated time; worked out in double precision
+    //so that rates above a million per second (intervals under the microsecond sf::Time resolves) still work
+    if (mParticlesPerSecond > 0.f && mAccumulatedTime > sf::Time::Zero)
     {
-        mAccumulatedTime -= timeInterval;
-        for(auto& modifier : mParticleModifiers)
-            modifier(particle, this);
-        
-        mParticleSystem->addParticle(particle);
+        const double interval = 1000000.0 / mParticlesPerSecond;
+        const double accumulated = static_cast<double>(mAccumulatedTime.asMicroseconds());
+        emitted = accumulated > interval ? static_cast<std::size_t>(std::ceil(accumulated / interval)) - 1 : 0;
+        mAccumulatedTime -= sf::microseconds(static_cast<sf::Int64>(std::llround(emitted * interval)));
     }
+
+    if (emitted)
+    {
+        //all newborns are added at once, modifiers then run over the whole batch
+        mParticleSystem->addParticles(emitted, mDefaultParticle, [this](Chunk newborn) { modify(newborn); });
+    }
+
+    if constexpr (stats::enabled)
+    {
+        mStats.emitted += emitted;
+        mStats.emission = stats::toTime(stats::now() - start);
+    }
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::modify(Chunk newborn)
+{
+    if (!mParticleModifiers.empty())
+    {
+        storage::forEachParticle(newborn, [this](ParticleType& particle)
+        {
+            for(auto& modifier : mParticleModifiers)
+                modifier(particle, this);
+        });
+    }
+    for(auto& modifier : mBatchModifiers)
+        modifier(newborn, this);
+}
+
+//the modifiers run as for any emission, then every particle is moved by its event's position, so the positions
+//they and the default particle give are relative to the event. At capacity the first events get their particles.
+template<typename ParticleType, typename InheritFrom, typename Storage>
+template <typename Event>
+void Emitter<ParticleType, InheritFrom, Storage>::emitAt(const std::vector<Event>& events, std::size_t count)
+{
+    if (!mParticleSystem || events.empty() || count == 0)
+        return;
+    const std::int64_t start = stats::now();
+    std::size_t emitted = 0;
+    mParticleSystem->addParticles(events.size() * count, mDefaultParticle, [this, &events, count, &emitted](Chunk newborn)
+    {
+        modify(newborn);
+        emitted = newborn.size();
+        for (std::size_t i = 0; i < emitted; ++i)
+        {
+            const sf::Vector2f offset = events[i / count].position;
+            if constexpr (std::is_same_v<Storage, storage::AoS>)
+                newborn[i].position += offset;
+            else if constexpr (std::is_same_v<Storage, storage::SoA>)
+                newborn.positions()[i] += offset;
+            else
+            {
+                ParticleType particle = newborn.get(i);
+                particle.position += offset;
+                newborn.set(i, particle);
+            }
+        }
+    });
+
+    if constexpr (stats::enabled)
+    {
+        mStats.emitted += emitted;
+        mStats.emission = stats::toTime(stats::now() - start);
+    }
+}
+
+//the particles go to this emitter's system, which a Scheduler then orders after parent's update
+template<typename ParticleType, typename InheritFrom, typename Storage>
+template <typename ParentType, typename ParentStorage>
+bool Emitter<ParticleType, InheritFrom, Storage>::emitOnDeath(ParticleSystem<ParentType, ParentStorage>& parent, std::size_t count)
+{
+    if (!mParticleSystem)
+        return false;
+    parent.addDeathListener([this, count](auto const& events) { emitAt(events, count); }, {{}, {sched::state(mParticleSystem)}});
+    return true;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+template <typename ParentType, typename ParentStorage>
+bool Emitter<ParticleType, InheritFrom, Storage>::emitOnSpawn(ParticleSystem<ParentType, ParentStorage>& parent, std::size_t count)
+{
+    if (!mParticleSystem)
+        return false;
+    parent.addSpawnListener([this, count](auto const& events) { emitAt(events, count); }, {{}, {sched::state(mParticleSystem)}});
+    return true;
 }
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::update(sf::Time dt)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::update(sf::Time dt)
 {
     if(mParticleSystem)
         emitParticles(dt);
 }
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::setEmissionRate(float rate)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::setEmissionRate(float rate)
 {
     mParticlesPerSecond = rate;
 }
 
-template<typename ParticleType, typename InheritFrom>
-float Emitter<ParticleType, InheritFrom>::getEmissionRate() const
+template<typename ParticleType, typename InheritFrom, typename Storage>
+float Emitter<ParticleType, InheritFrom, Storage>::getEmissionRate() const
 {
     return mParticlesPerSecond;
 }
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::addModifier(std::function<void(ParticleType&, Emitter<ParticleType>*)> modifier)
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::setAccumulatedTime(sf::Time time)
+{
+    mAccumulatedTime = time;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+sf::Time Emitter<ParticleType, InheritFrom, Storage>::getAccumulatedTime() const
+{
+    return mAccumulatedTime;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::addModifier(std::function<void(ParticleType&, Emitter*)> modifier)
 {
     mParticleModifiers.push_back(modifier);
 }
 
-template<typename ParticleType, typename InheritFrom>
-void Emitter<ParticleType, InheritFrom>::setParticleSystem(ParticleSystem<ParticleType>* system)
+//called once per update() with every particle emitted by it, after the per-particle modifiers
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::addBatchModifier(std::function<void(Chunk, Emitter*)> modifier)
+{
+    mBatchModifiers.push_back(modifier);
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+Rng& Emitter<ParticleType, InheritFrom, Storage>::getRng()
+{
+    return mRng;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+const Rng& Emitter<ParticleType, InheritFrom, Storage>::getRng() const
+{
+    return mRng;
+}
+
+//same seed, same stream of numbers for the modifiers, whatever other emitters or threads draw
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::seed(std::uint64_t seed)
+{
+    mRng.seed(seed);
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+const EmitterStats& Emitter<ParticleType, InheritFrom, Storage>::getStats() const
+{
+    return mStats;
+}
+
+template<typename ParticleType, typename InheritFrom, typename Storage>
+void Emitter<ParticleType, InheritFrom, Storage>::setParticleSystem(ParticleSystem<ParticleType, Storage>* system)
 {
     mParticleSystem = system;
 }
@@ -0,0 +1,187 @@
+#include "Fields.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    //deterministic hash of a lattice point to [-1, 1]
+    float lattice(std::int32_t x, std::int32_t y, std::uint32_t seed)
+    {
+        std::uint32_t h = static_cast<std::uint32_t>(x) * 374761393u + static_cast<std::uint32_t>(y) * 668265263u + seed * 2246822519u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        h ^= h >> 16;
+        return static_cast<float>(h & 0xffffffu) * (2.f / 16777215.f) - 1.f;
+    }
+
+    //value noise with a smoothstep between lattice points, about 1 unit per feature
+    float noise(float x, float y, std::uint32_t seed)
+    {
+        const float fx = std::floor(x), fy = std::floor(y);
+        const std::int32_t ix = static_cast<std::int32_t>(fx), iy = static_cast<std::int32_t>(fy);
+        const float tx = x - fx, ty = y - fy;
+        const float sx = tx * tx * (3.f - 2.f * tx);
+        const float sy = ty * ty * (3.f - 2.f * ty);
+        const float top = lattice(ix, iy, seed) + (lattice(ix + 1, iy, seed) - lattice(ix, iy, seed)) * sx;
+        const float bottom = lattice(ix, iy + 1, seed) + (lattice(ix + 1, iy + 1, seed) - lattice(ix, iy + 1, seed)) * sx;
+        return top + (bottom - top) * sy;
+    }
+}
+
+namespace field
+{
+    Field gravity(sf::Vector2f center, float strength, float softening)
+    {
+        const float soft2 = softening * softening;
+        return [center, strength, soft2](sf::Vector2f position)
+        {
+            const sf::Vector2f d = center - position;
+            return d * (strength / (d.x * d.x + d.y * d.y + soft2));
+        };
+    }
+
+    Field vortex(sf::Vector2f center, float angularSpeed, float radius)
+    {
+        const float inverseRadius2 = radius > 0.f ? 1.f / (radius * radius) : 0.f;
+        return [center, angularSpeed, inverseRadius2](sf::Vector2f position)
+        {
+            const sf::Vector2f d = position - center;
+            const float falloff = 1.f / (1.f + (d.x * d.x + d.y * d.y) * inverseRadius2);
+            return sf::Vector2f{-d.y, d.x} * (angularSpeed * falloff);
+        };
+    }
+
+    Field wind(sf::Vector2f velocity)
+    {
+        return [velocity](sf::Vector2f) { return velocity; };
+    }
+
+    Field turbulence(float size, float strength, std::uint32_t seed)
+    {
+        const float frequency = size > 0.f ? 1.f / size : 0.f;
+        return [frequency, strength, seed](sf::Vector2f position)
+        {
+            //velocity = (d/dy, -d/dx) of the noise, central differences in noise space
+            const float x = position.x * frequency, y = position.y * frequency;
+            const float e = 0.01f;
+            const float dx = noise(x + e, y, seed) - noise(x - e, y, seed);
+            const float dy = noise(x, y + e, seed) - noise(x, y - e, seed);
+            return sf::Vector2f{dy, -dx} * (strength / (2.f * e));
+        };
+    }
+}
+
+FieldGrid::FieldGrid(sf::FloatRect area, sf::Vector2u resolution)
+: mArea()
+, mResolution()
+, mInverseCell()
+, mFields()
+, mGrid()
+{
+    setArea(area, resolution);
+}
+
+std::size_t FieldGrid::addField(Field field)
+{
+    mFields.push_back(std::move(field));
+    markChanged();
+    return mFields.size() - 1;
+}
+
+void FieldGrid::setField(std::size_t id, Field field)
+{
+    mFields.at(id) = std::move(field);
+    markChanged();
+}
+
+void FieldGrid::clearFields()
+{
+    mFields.clear();
+    markChanged();
+}
+
+void FieldGrid::setArea(sf::FloatRect area, sf::Vector2u resolution)
+{
+    mArea = area;
+    mResolution = {std::max(resolution.x, 2u), std::max(resolution.y, 2u)};
+    mInverseCell = {area.width > 0.f ? (mResolution.x - 1) / area.width : 0.f,
+                    area.height > 0.f ? (mResolution.y - 1) / area.height : 0.f};
+    markChanged();
+}
+
+void FieldGrid::setThreadPool(ThreadPool* pool)
+{
+    mThreadPool = pool;
+}
+
+ThreadPool* FieldGrid::getThreadPool() const
+{
+    return mThreadPool;
+}
+
+void FieldGrid::markChanged()
+{
+    mBaked.store(false, std::memory_order_release);
+}
+
+bool FieldGrid::isBaked() const
+{
+    return mBaked.load(std::memory_order_acquire);
+}
+
+//baked into a grid of its own and published under the lock, so no lock is held across parallelFor(): a thread
+//waiting there runs other jobs of the pool, which may bake as well
+void FieldGrid::bake()
+{
+    if (isBaked())
+        return;
+
+    const std::size_t width = mResolution.x;
+    const std::size_t height = mResolution.y;
+    const sf::Vector2f cell{mArea.width / (width - 1), mArea.height / (height - 1)};
+    std::vector<sf::Vector2f> grid(width * height);
+    ThreadPool::run(mThreadPool, height, 8, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t y = begin; y < end; ++y)
+        {
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                const sf::Vector2f position{mArea.left + x * cell.x, mArea.top + y * cell.y};
+                sf::Vector2f& value = grid[y * width + x];
+                for (auto& field : mFields)
+                    value += field(position);
+            }
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(mPublishMutex);
+    if (isBaked())
+        return;
+    mGrid.swap(grid);
+    mBaked.store(true, std::memory_order_release);
+}
+
+sf::Vector2f FieldGrid::sample(sf::Vector2f position) const
+{
+    sf::Vector2f value;
+    sample(&position, 1, &value);
+    return value;
+}
+
+void FieldGrid::sample(const sf::Vector2f* positions, std::size_t count, sf::Vector2f* out) const
+{
+    std::fill(out, out + count, sf::Vector2f());
+    if (!mGrid.empty())
+        simd::sampleGrid(positions, count, mGrid.data(), mResolution.x, mResolution.y, {mArea.left, mArea.top}, mInverseCell, 1.f, out);
+}
+
+void FieldGrid::advect(sf::Vector2f* positions, std::size_t count, sf::Time dt) const
+{
+    if (!mGrid.empty())
+        simd::sampleGrid(positions, count, mGrid.data(), mResolution.x, mResolution.y, {mArea.left, mArea.top}, mInverseCell, dt.asSeconds(), positions);
+}
+
+std::size_t FieldGrid::bytes() const
+{
+    return mGrid.capacity() * sizeof(sf::Vector2f);
+}
@@ -0,0 +1,122 @@
+#ifndef FIELDS_HPP
+#define FIELDS_HPP
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "ParticleStorage.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// Velocity field at a position, in pixels per second.
+using Field = std::function<sf::Vector2f(sf::Vector2f position)>;
+
+namespace field
+{
+    //pulls towards center with strength / distance; softening keeps the middle from blowing up
+    Field gravity(sf::Vector2f center, float strength, float softening = 8.f);
+    //spins about center at angularSpeed radians per second, fading out past radius
+    Field vortex(sf::Vector2f center, float angularSpeed, float radius);
+    //the same velocity everywhere
+    Field wind(sf::Vector2f velocity);
+    //divergence-free swirls (curl of smooth value noise) of about the given size in pixels
+    Field turbulence(float size, float strength, std::uint32_t seed = 0);
+}
+
+// Sum of any number of Fields, baked into a grid of vectors over a fixed area.
+// The fields are only evaluated when the grid is (re)baked, i.e. after a field or the area changed;
+// particles then pay one bilinear lookup, however many fields there are. Positions outside the area
+// get the value at the nearest edge.
+class FieldGrid
+{
+public:
+    //resolution is the number of grid points along each side, at least 2 x 2
+    FieldGrid(sf::FloatRect area, sf::Vector2u resolution);
+public:
+    //returns an id for setField()
+    std::size_t addField(Field field);
+    void setField(std::size_t id, Field field);
+    void clearFields();
+    void setArea(sf::FloatRect area, sf::Vector2u resolution);
+    //bakes on the pool as well, and field::advect() runs on it
+    void setThreadPool(ThreadPool* pool);
+    ThreadPool* getThreadPool() const;
+
+    //bakes if anything changed since the last bake; safe to call from several threads at once, and from a job of
+    //the pool (no lock is held while baking, threads that bake at the same time each bake and the first one wins)
+    void bake();
+    bool isBaked() const;
+
+    //sample() and advect() read the last bake
+    sf::Vector2f sample(sf::Vector2f position) const;
+    //out[i] = sample(positions[i])
+    void sample(const sf::Vector2f* positions, std::size_t count, sf::Vector2f* out) const;
+    //positions[i] += sample(positions[i]) * dt, vectorized
+    void advect(sf::Vector2f* positions, std::size_t count, sf::Time dt) const;
+    std::size_t bytes() const;
+private:
+    void markChanged();
+private:
+    sf::FloatRect mArea;
+    sf::Vector2u mResolution;
+    sf::Vector2f mInverseCell;
+    std::vector<Field> mFields;
+    std::vector<sf::Vector2f> mGrid;
+    ThreadPool* mThreadPool = nullptr;
+    std::atomic<bool> mBaked{false};
+    std::mutex mPublishMutex;
+};
+
+namespace field
+{
+    //affector for ParticleSystem<ParticleType, Storage>::addAffector() that moves every particle through
+    //the grid by step per update(). It bakes the grid first if it changed, once, on the thread running the
+    //affector, then goes chunk by chunk over the grid's pool (see FieldGrid::setThreadPool()).
+    //AoS and Compact positions are copied out to a contiguous buffer and back around the vectorized pass.
+    template <typename ParticleType, typename Storage = storage::AoS>
+    auto advect(FieldGrid& grid, sf::Time step, std::size_t chunkSize = 4096)
+    {
+        return [&grid, step, chunkSize](storage::container_t<ParticleType, Storage>& particles)
+        {
+            grid.bake();
+            ThreadPool::run(grid.getThreadPool(), particles.size(), chunkSize, [&grid, &particles, step](std::size_t begin, std::size_t end)
+            {
+                auto chunk = storage::slice(particles, begin, end);
+                if constexpr (std::is_same_v<Storage, storage::SoA>)
+                {
+                    grid.advect(chunk.positions().begin(), chunk.size(), step);
+                }
+                else
+                {
+                    thread_local std::vector<sf::Vector2f> positions;
+                    positions.resize(chunk.size());
+                    for (std::size_t i = 0; i < chunk.size(); ++i)
+                        positions[i] = chunk[i].position;
+                    grid.advect(positions.data(), positions.size(), step);
+                    for (std::size_t i = 0; i < chunk.size(); ++i)
+                    {
+                        if constexpr (std::is_same_v<Storage, storage::Compact>)
+                        {
+                            ParticleType particle = chunk.get(i);
+                            particle.position = positions[i];
+                            chunk.set(i, particle);
+                        }
+                        else
+                            chunk[i].position = positions[i];
+                    }
+                }
+            });
+        };
+    }
+}
+
+#endif
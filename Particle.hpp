@@ -8,6 +8,7 @@
 #include <vector>
 #include <tuple>
 #include <cstdint>
+#include <type_traits>
 
 // enum class Tags : uint32_t {
 //     position    = 1u << 0u,
@@ -59,7 +60,9 @@
 
 //attempt 3 : using mixins/direct composition
 
-template <typename T> 
+struct NoAttributes {};
+
+template <typename T = NoAttributes> 
 struct BaseParticle : public T
 {
     sf::Vector2f position = {0.f,0.f};
@@ -74,8 +77,116 @@ namespace attr
     template<typename T>
     inline constexpr bool has_color_v<T, std::void_t<decltype(T::color)>> = std::true_type{};
 
+    //a `sf::FloatRect textureRect` member picks the part of the system's texture (in pixels) a particle is drawn with,
+    //and the particle's quad takes that rect's size
+    template<typename, typename = void>
+    inline constexpr bool has_texture_rect_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_texture_rect_v<T, std::void_t<decltype(T::textureRect)>> = std::true_type{};
+
+    //a `size` member (float for a square, or sf::Vector2f) replaces the system's quad size for that particle
+    template<typename, typename = void>
+    inline constexpr bool has_size_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_size_v<T, std::void_t<decltype(T::size)>> = std::true_type{};
+
+    //a `float rotation` member turns the particle's quad, in degrees clockwise like sf::Transformable
+    template<typename, typename = void>
+    inline constexpr bool has_rotation_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_rotation_v<T, std::void_t<decltype(T::rotation)>> = std::true_type{};
+
+    //a `sf::Vector2f velocity` member (pixels per second) is added to the position by every update() if the mixin integrates
+    template<typename, typename = void>
+    inline constexpr bool has_velocity_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_velocity_v<T, std::void_t<decltype(T::velocity)>> = std::true_type{};
+
+    //a `float angularVelocity` member (degrees per second) is added to the rotation by every update() if the mixin integrates
+    template<typename, typename = void>
+    inline constexpr bool has_angular_velocity_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_angular_velocity_v<T, std::void_t<decltype(T::angularVelocity)>> = std::true_type{};
+
+    //update() only integrates velocity and angularVelocity if the mixin says `static constexpr bool integrate = true;`,
+    //so a mixin that already moves its particles by them in an affector of its own isn't moved twice
+    template<typename T, typename = void>
+    inline constexpr bool integrates_v = false;
+
+    template<typename T>
+    inline constexpr bool integrates_v<T, std::void_t<decltype(T::integrate)>> = T::integrate;
+
+    template<typename T>
+    inline constexpr bool integrates_velocity_v = integrates_v<T> && has_velocity_v<T>;
+
+    template<typename T>
+    inline constexpr bool integrates_angular_velocity_v = integrates_v<T> && has_angular_velocity_v<T> && has_rotation_v<T>;
+
+    //a `sortKey` member (any number) draws particles by ascending key instead of storage order, ties in storage order;
+    //every update() then sorts the particles themselves by it
+    template<typename, typename = void>
+    inline constexpr bool has_sort_key_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_sort_key_v<T, std::void_t<decltype(T::sortKey)>> = std::true_type{};
+
+    //a `payload` member (anything copyable) is copied into the particle's spawn and death events
+    template<typename, typename = void>
+    inline constexpr bool has_payload_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_payload_v<T, std::void_t<decltype(T::payload)>> = std::true_type{};
+
+    template<typename T, typename = void>
+    struct payload { struct type {}; };
+
+    template<typename T>
+    struct payload<T, std::void_t<decltype(T::payload)>> { using type = std::decay_t<decltype(T::payload)>; };
+
+    template<typename T>
+    using payload_t = typename payload<T>::type;
+
+    //particles without a color fade out with their lifetime, unless the mixin says `static constexpr bool fade = false;`
+    //and keeps the system's default color instead
+    template<typename T, typename = void>
+    inline constexpr bool fades_v = !has_color_v<T>;
+
+    template<typename T>
+    inline constexpr bool fades_v<T, std::void_t<decltype(T::fade)>> = !has_color_v<T> && T::fade;
+
+    //a mixin may list its members as `static constexpr auto fields = std::make_tuple(&Mixin::a, &Mixin::b);`
+    //so that struct-of-arrays storage can give every member its own column
+    template<typename, typename = void>
+    inline constexpr bool has_fields_v = std::false_type{};
+
+    template<typename T>
+    inline constexpr bool has_fields_v<T, std::void_t<decltype(T::fields)>> = std::true_type{};
+
+    //the mixin a BaseParticle was composed from
+    template<typename ParticleType>
+    struct mixin;
+
+    template<typename T>
+    struct mixin<BaseParticle<T>> { using type = T; };
+
+    template<typename ParticleType>
+    using mixin_t = typename mixin<ParticleType>::type;
 }
 
+//a particle that was born or died, as ParticleSystem hands them to listeners
+template <typename Payload>
+struct ParticleEvent
+{
+    sf::Vector2f position;
+    sf::Time age;       //for a death, the time the particle was simulated for since it was added; zero for a spawn
+    Payload payload;    //the particle's `payload` member, if it has one
+};
+
 
 
 #endif
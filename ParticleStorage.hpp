@@ -0,0 +1,1177 @@
+#ifndef PARTICLESTORAGE_HPP
+#define PARTICLESTORAGE_HPP
+
+#include "Particle.hpp"
+#include "Quantized.hpp"
+#include "Simd.hpp"
+
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Storage policies for ParticleSystem.
+// AoS keeps whole particles next to each other in a std::vector (the default).
+// SoA splits BaseParticle's position and lifetime, and the mixin's members, into one contiguous array each,
+// so a pass that only touches lifetimes streams through lifetimes and nothing else.
+// Compact packs every particle into a small record, position and lifetime in 16 bit fixed point (see quant::Codec),
+// for huge ambient effects where memory matters more than precision.
+namespace storage
+{
+    struct AoS {};
+    struct SoA {};
+    struct Compact {};
+
+    // How dead particles are reclaimed.
+    // Unordered moves the last particle into the dead one's slot, O(1) per death.
+    // Ordered compacts the survivors in one sweep and keeps emission order.
+    // Neither gives memory back: freed slots are reused by the next particles added.
+    enum class Removal
+    {
+        Unordered,
+        Ordered
+    };
+
+    // What happens to particles added to a system that is at its capacity.
+    // Drop turns the newcomers away. ReplaceOldest evicts the particles with the least lifetime left to make room.
+    // Thin evicts randomly picked particles, so the population gets sparser evenly instead of losing its old or new end.
+    enum class Admission
+    {
+        Drop,
+        ReplaceOldest,
+        Thin
+    };
+}
+
+namespace detail
+{
+    template<typename Member>
+    struct member_type;
+
+    template<typename Class, typename Type>
+    struct member_type<Type Class::*> { using type = Type; };
+
+    template<typename Fields>
+    struct field_columns;
+
+    template<typename... Members>
+    struct field_columns<std::tuple<Members...>>
+    {
+        using type = std::tuple<std::vector<typename member_type<Members>::type>...>;
+    };
+
+    //mixins without a field list are kept whole, in a single column
+    template<typename Mixin, typename = void>
+    struct mixin_columns
+    {
+        using type = std::tuple<std::vector<Mixin>>;
+    };
+
+    template<typename Mixin>
+    struct mixin_columns<Mixin, std::enable_if_t<attr::has_fields_v<Mixin>>>
+    {
+        using type = typename field_columns<std::decay_t<decltype(Mixin::fields)>>::type;
+    };
+
+    //position of Member inside Mixin::fields, or the tuple size if it isn't listed
+    template<typename Mixin, auto Member, std::size_t I = 0>
+    constexpr std::size_t fieldIndex()
+    {
+        using Fields = std::decay_t<decltype(Mixin::fields)>;
+        if constexpr (I == std::tuple_size_v<Fields>)
+        {
+            return I;
+        }
+        else
+        {
+            if constexpr (std::is_same_v<std::tuple_element_t<I, Fields>, decltype(Member)>)
+            {
+                if (std::get<I>(Mixin::fields) == Member)
+                    return I;
+            }
+            return fieldIndex<Mixin, Member, I + 1>();
+        }
+    }
+}
+
+template <typename ParticleType>
+class ParticleColumns
+{
+public:
+    using Mixin = attr::mixin_t<ParticleType>;
+    using Columns = typename detail::mixin_columns<Mixin>::type;
+public:
+    void push_back(ParticleType const& particle);
+    //count copies of particle at the end, with a single allocation at most per column
+    void append(std::size_t count, ParticleType const& particle);
+    ParticleType get(std::size_t index) const;
+    void set(std::size_t index, ParticleType const& particle);
+    void move(std::size_t from, std::size_t to);
+    void resize(std::size_t count);
+    void reserve(std::size_t count);
+    void clear();
+    std::size_t size() const;
+    bool empty() const;
+    //memory reserved by all columns
+    std::size_t bytes() const;
+public:
+    std::vector<sf::Vector2f>& positions();
+    const std::vector<sf::Vector2f>& positions() const;
+    std::vector<sf::Time>& lifetimes();
+    const std::vector<sf::Time>& lifetimes() const;
+    //the whole column of a mixin member, e.g. column<&my::ColorAndRadius::radius>(); needs Mixin::fields
+    template <auto Member>
+    auto& column();
+    template <auto Member>
+    const auto& column() const;
+    //a single mixin member, whether or not the mixin lists its fields
+    template <auto Member>
+    decltype(auto) value(std::size_t index);
+    template <auto Member>
+    decltype(auto) value(std::size_t index) const;
+    //calls function(std::vector<T>&) for every column: positions, lifetimes, then the mixin's
+    template <typename Function>
+    void forEachColumn(Function&& function);
+    template <typename Function>
+    void forEachColumn(Function&& function) const;
+    //calls function(std::vector<T>&, std::vector<T>&) for every column together with the same column of other
+    template <typename Function>
+    void forEachColumn(ParticleColumns& other, Function&& function);
+private:
+    template <std::size_t... I>
+    void pushMixin(Mixin const& mixin, std::index_sequence<I...>);
+    template <std::size_t... I>
+    void readMixin(std::size_t index, Mixin& mixin, std::index_sequence<I...>) const;
+    template <std::size_t... I>
+    void writeMixin(std::size_t index, Mixin const& mixin, std::index_sequence<I...>);
+private:
+    std::vector<sf::Vector2f> mPositions;
+    std::vector<sf::Time> mLifetimes;
+    Columns mAttributes;
+};
+
+//a contiguous run of T, what chunk affectors of an AoS system are handed
+template <typename T>
+struct Span
+{
+    T* first;
+    T* last;
+
+    T* begin() const { return first; }
+    T* end() const { return last; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    T& operator[](std::size_t index) const { return first[index]; }
+};
+
+//particles [begin, end) of a ParticleColumns, what chunk affectors of an SoA system are handed
+template <typename ParticleType>
+class ColumnSpan
+{
+public:
+    using Mixin = attr::mixin_t<ParticleType>;
+public:
+    ColumnSpan(ParticleColumns<ParticleType>& columns, std::size_t begin, std::size_t end);
+    Span<sf::Vector2f> positions() const;
+    Span<sf::Time> lifetimes() const;
+    ParticleType get(std::size_t index) const;
+    void set(std::size_t index, ParticleType const& particle) const;
+    template <auto Member>
+    auto column() const;
+    //index is relative to the start of the chunk
+    template <auto Member>
+    decltype(auto) value(std::size_t index) const;
+    std::size_t size() const;
+    //index of the chunk's first particle within the whole system
+    std::size_t offset() const;
+private:
+    ParticleColumns<ParticleType>* mColumns;
+    std::size_t mBegin;
+    std::size_t mEnd;
+};
+
+// What storage::Compact keeps particles in: one record per particle, the position as two 16 bit fixed-point
+// coordinates and the lifetime as 16 bit ticks, packed and unpacked by a quant::Codec, next to the mixin as it is.
+// A BaseParticle<> takes 6 bytes instead of 16; keep the mixin small too, e.g. with quant::Unorm8 members.
+// Particles are handed out unpacked, by value: read them with operator[] or get(), write them back with set().
+template <typename ParticleType>
+class CompactParticles
+{
+public:
+    using Mixin = attr::mixin_t<ParticleType>;
+    //the mixin as a base, so an empty one takes no room
+    struct Record : Mixin
+    {
+        std::int16_t x;
+        std::int16_t y;
+        std::uint16_t ticks;
+    };
+public:
+    void push_back(ParticleType const& particle);
+    void append(std::size_t count, ParticleType const& particle);
+    //const, so that writing to a member of the unpacked copy doesn't compile instead of being lost
+    const ParticleType operator[](std::size_t index) const;
+    ParticleType get(std::size_t index) const;
+    void set(std::size_t index, ParticleType const& particle);
+    sf::Vector2f position(std::size_t index) const;
+    sf::Time lifetime(std::size_t index) const;
+    void kill(std::size_t index);
+    void resize(std::size_t count);
+    void reserve(std::size_t count);
+    void clear();
+    std::size_t size() const;
+    bool empty() const;
+    std::size_t bytes() const;
+    //packs the particles already there again with the new codec
+    void setCodec(quant::Codec const& codec);
+    const quant::Codec& getCodec() const;
+    std::vector<Record>& records();
+    const std::vector<Record>& records() const;
+private:
+    static Record pack(ParticleType const& particle, quant::Codec const& codec, sf::Vector2f dither = {0.5f, 0.5f});
+    static ParticleType unpack(Record const& record, quant::Codec const& codec);
+private:
+    std::vector<Record> mRecords;
+    quant::Codec mCodec;
+};
+
+//particles [begin, end) of a CompactParticles, what chunk affectors of a Compact system are handed
+template <typename ParticleType>
+class CompactSpan
+{
+public:
+    CompactSpan(CompactParticles<ParticleType>& particles, std::size_t begin, std::size_t end);
+    //index is relative to the start of the chunk
+    const ParticleType operator[](std::size_t index) const;
+    ParticleType get(std::size_t index) const;
+    void set(std::size_t index, ParticleType const& particle) const;
+    std::size_t size() const;
+    //index of the chunk's first particle within the whole system
+    std::size_t offset() const;
+private:
+    CompactParticles<ParticleType>* mParticles;
+    std::size_t mBegin;
+    std::size_t mEnd;
+};
+
+namespace storage
+{
+    template <typename ParticleType, typename Storage>
+    struct container;
+
+    template <typename ParticleType>
+    struct container<ParticleType, AoS> { using type = std::vector<ParticleType>; };
+
+    template <typename ParticleType>
+    struct container<ParticleType, SoA> { using type = ParticleColumns<ParticleType>; };
+
+    template <typename ParticleType>
+    struct container<ParticleType, Compact> { using type = CompactParticles<ParticleType>; };
+
+    template <typename ParticleType, typename Storage>
+    using container_t = typename container<ParticleType, Storage>::type;
+
+    template <typename ParticleType, typename Storage>
+    struct chunk;
+
+    template <typename ParticleType>
+    struct chunk<ParticleType, AoS> { using type = Span<ParticleType>; };
+
+    template <typename ParticleType>
+    struct chunk<ParticleType, SoA> { using type = ColumnSpan<ParticleType>; };
+
+    template <typename ParticleType>
+    struct chunk<ParticleType, Compact> { using type = CompactSpan<ParticleType>; };
+
+    template <typename ParticleType, typename Storage>
+    using chunk_t = typename chunk<ParticleType, Storage>::type;
+}
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType>
+template <std::size_t... I>
+void ParticleColumns<ParticleType>::pushMixin(Mixin const& mixin, std::index_sequence<I...>)
+{
+    if constexpr (attr::has_fields_v<Mixin>)
+        (std::get<I>(mAttributes).push_back(mixin.*std::get<I>(Mixin::fields)), ...);
+    else
+        std::get<0>(mAttributes).push_back(mixin);
+}
+
+template <typename ParticleType>
+template <std::size_t... I>
+void ParticleColumns<ParticleType>::readMixin(std::size_t index, Mixin& mixin, std::index_sequence<I...>) const
+{
+    if constexpr (attr::has_fields_v<Mixin>)
+        ((mixin.*std::get<I>(Mixin::fields) = std::get<I>(mAttributes)[index]), ...);
+    else
+        mixin = std::get<0>(mAttributes)[index];
+}
+
+template <typename ParticleType>
+template <std::size_t... I>
+void ParticleColumns<ParticleType>::writeMixin(std::size_t index, Mixin const& mixin, std::index_sequence<I...>)
+{
+    if constexpr (attr::has_fields_v<Mixin>)
+        ((std::get<I>(mAttributes)[index] = mixin.*std::get<I>(Mixin::fields)), ...);
+    else
+        std::get<0>(mAttributes)[index] = mixin;
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::push_back(ParticleType const& particle)
+{
+    mPositions.push_back(particle.position);
+    mLifetimes.push_back(particle.lifetime);
+    pushMixin(particle, std::make_index_sequence<std::tuple_size_v<Columns>>{});
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::append(std::size_t count, ParticleType const& particle)
+{
+    const std::size_t first = size();
+    resize(first + count);
+    for (std::size_t i = first; i < first + count; ++i)
+        set(i, particle);
+}
+
+template <typename ParticleType>
+ParticleType ParticleColumns<ParticleType>::get(std::size_t index) const
+{
+    ParticleType particle;
+    particle.position = mPositions[index];
+    particle.lifetime = mLifetimes[index];
+    readMixin(index, particle, std::make_index_sequence<std::tuple_size_v<Columns>>{});
+    return particle;
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::set(std::size_t index, ParticleType const& particle)
+{
+    mPositions[index] = particle.position;
+    mLifetimes[index] = particle.lifetime;
+    writeMixin(index, particle, std::make_index_sequence<std::tuple_size_v<Columns>>{});
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::move(std::size_t from, std::size_t to)
+{
+    mPositions[to] = mPositions[from];
+    mLifetimes[to] = mLifetimes[from];
+    std::apply([from, to](auto&... column) { ((column[to] = std::move(column[from])), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::resize(std::size_t count)
+{
+    mPositions.resize(count);
+    mLifetimes.resize(count);
+    std::apply([count](auto&... column) { (column.resize(count), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::reserve(std::size_t count)
+{
+    mPositions.reserve(count);
+    mLifetimes.reserve(count);
+    std::apply([count](auto&... column) { (column.reserve(count), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+void ParticleColumns<ParticleType>::clear()
+{
+    mPositions.clear();
+    mLifetimes.clear();
+    std::apply([](auto&... column) { (column.clear(), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+std::size_t ParticleColumns<ParticleType>::size() const
+{
+    return mLifetimes.size();
+}
+
+template <typename ParticleType>
+bool ParticleColumns<ParticleType>::empty() const
+{
+    return mLifetimes.empty();
+}
+
+template <typename ParticleType>
+std::size_t ParticleColumns<ParticleType>::bytes() const
+{
+    std::size_t total = mPositions.capacity() * sizeof(sf::Vector2f) + mLifetimes.capacity() * sizeof(sf::Time);
+    std::apply([&total](auto const&... column) { ((total += column.capacity() * sizeof(column[0])), ...); }, mAttributes);
+    return total;
+}
+
+template <typename ParticleType>
+template <typename Function>
+void ParticleColumns<ParticleType>::forEachColumn(Function&& function)
+{
+    function(mPositions);
+    function(mLifetimes);
+    std::apply([&function](auto&... column) { (function(column), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+template <typename Function>
+void ParticleColumns<ParticleType>::forEachColumn(Function&& function) const
+{
+    function(mPositions);
+    function(mLifetimes);
+    std::apply([&function](auto const&... column) { (function(column), ...); }, mAttributes);
+}
+
+template <typename ParticleType>
+template <typename Function>
+void ParticleColumns<ParticleType>::forEachColumn(ParticleColumns& other, Function&& function)
+{
+    function(mPositions, other.mPositions);
+    function(mLifetimes, other.mLifetimes);
+    std::apply([&function, &other](auto&... column)
+    {
+        std::apply([&function, &column...](auto&... otherColumn) { (function(column, otherColumn), ...); }, other.mAttributes);
+    }, mAttributes);
+}
+
+template <typename ParticleType>
+std::vector<sf::Vector2f>& ParticleColumns<ParticleType>::positions()
+{
+    return mPositions;
+}
+
+template <typename ParticleType>
+const std::vector<sf::Vector2f>& ParticleColumns<ParticleType>::positions() const
+{
+    return mPositions;
+}
+
+template <typename ParticleType>
+std::vector<sf::Time>& ParticleColumns<ParticleType>::lifetimes()
+{
+    return mLifetimes;
+}
+
+template <typename ParticleType>
+const std::vector<sf::Time>& ParticleColumns<ParticleType>::lifetimes() const
+{
+    return mLifetimes;
+}
+
+template <typename ParticleType>
+template <auto Member>
+auto& ParticleColumns<ParticleType>::column()
+{
+    static_assert(attr::has_fields_v<Mixin>, "per-member columns need the mixin to declare its fields");
+    constexpr std::size_t index = detail::fieldIndex<Mixin, Member>();
+    static_assert(index < std::tuple_size_v<Columns>, "member is not listed in the mixin's fields");
+    return std::get<index>(mAttributes);
+}
+
+template <typename ParticleType>
+template <auto Member>
+const auto& ParticleColumns<ParticleType>::column() const
+{
+    static_assert(attr::has_fields_v<Mixin>, "per-member columns need the mixin to declare its fields");
+    constexpr std::size_t index = detail::fieldIndex<Mixin, Member>();
+    static_assert(index < std::tuple_size_v<Columns>, "member is not listed in the mixin's fields");
+    return std::get<index>(mAttributes);
+}
+
+template <typename ParticleType>
+template <auto Member>
+decltype(auto) ParticleColumns<ParticleType>::value(std::size_t index)
+{
+    if constexpr (attr::has_fields_v<Mixin>)
+        return (column<Member>()[index]);
+    else
+        return (std::get<0>(mAttributes)[index].*Member);
+}
+
+template <typename ParticleType>
+template <auto Member>
+decltype(auto) ParticleColumns<ParticleType>::value(std::size_t index) const
+{
+    if constexpr (attr::has_fields_v<Mixin>)
+        return (column<Member>()[index]);
+    else
+        return (std::get<0>(mAttributes)[index].*Member);
+}
+
+template <typename ParticleType>
+ColumnSpan<ParticleType>::ColumnSpan(ParticleColumns<ParticleType>& columns, std::size_t begin, std::size_t end)
+: mColumns(&columns)
+, mBegin(begin)
+, mEnd(end)
+{
+
+}
+
+template <typename ParticleType>
+Span<sf::Vector2f> ColumnSpan<ParticleType>::positions() const
+{
+    sf::Vector2f* data = mColumns->positions().data();
+    return {data + mBegin, data + mEnd};
+}
+
+template <typename ParticleType>
+Span<sf::Time> ColumnSpan<ParticleType>::lifetimes() const
+{
+    sf::Time* data = mColumns->lifetimes().data();
+    return {data + mBegin, data + mEnd};
+}
+
+template <typename ParticleType>
+ParticleType ColumnSpan<ParticleType>::get(std::size_t index) const
+{
+    return mColumns->get(mBegin + index);
+}
+
+template <typename ParticleType>
+void ColumnSpan<ParticleType>::set(std::size_t index, ParticleType const& particle) const
+{
+    mColumns->set(mBegin + index, particle);
+}
+
+template <typename ParticleType>
+template <auto Member>
+auto ColumnSpan<ParticleType>::column() const
+{
+    auto* data = mColumns->template column<Member>().data();
+    return Span<std::remove_reference_t<decltype(*data)>>{data + mBegin, data + mEnd};
+}
+
+template <typename ParticleType>
+template <auto Member>
+decltype(auto) ColumnSpan<ParticleType>::value(std::size_t index) const
+{
+    return mColumns->template value<Member>(mBegin + index);
+}
+
+template <typename ParticleType>
+std::size_t ColumnSpan<ParticleType>::size() const
+{
+    return mEnd - mBegin;
+}
+
+template <typename ParticleType>
+std::size_t ColumnSpan<ParticleType>::offset() const
+{
+    return mBegin;
+}
+
+template <typename ParticleType>
+auto CompactParticles<ParticleType>::pack(ParticleType const& particle, quant::Codec const& codec, sf::Vector2f dither) -> Record
+{
+    Record record;
+    static_cast<Mixin&>(record) = static_cast<Mixin const&>(particle);
+    record.x = codec.encode(particle.position.x, codec.origin.x, dither.x);
+    record.y = codec.encode(particle.position.y, codec.origin.y, dither.y);
+    record.ticks = codec.encode(particle.lifetime);
+    return record;
+}
+
+template <typename ParticleType>
+ParticleType CompactParticles<ParticleType>::unpack(Record const& record, quant::Codec const& codec)
+{
+    ParticleType particle;
+    static_cast<Mixin&>(particle) = static_cast<Mixin const&>(record);
+    particle.position = {codec.decode(record.x, codec.origin.x), codec.decode(record.y, codec.origin.y)};
+    particle.lifetime = codec.decode(record.ticks);
+    return particle;
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::push_back(ParticleType const& particle)
+{
+    mRecords.push_back(pack(particle, mCodec));
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::append(std::size_t count, ParticleType const& particle)
+{
+    mRecords.insert(mRecords.end(), count, pack(particle, mCodec));
+}
+
+template <typename ParticleType>
+const ParticleType CompactParticles<ParticleType>::operator[](std::size_t index) const
+{
+    return unpack(mRecords[index], mCodec);
+}
+
+template <typename ParticleType>
+ParticleType CompactParticles<ParticleType>::get(std::size_t index) const
+{
+    return unpack(mRecords[index], mCodec);
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::set(std::size_t index, ParticleType const& particle)
+{
+    //rounded at random like in storage::age(), so that affectors moving particles by less than a step still move them
+    const auto i = static_cast<std::uint32_t>(index);
+    const std::uint16_t ticks = mRecords[index].ticks;
+    mRecords[index] = pack(particle, mCodec, {quant::dither(i, ticks ^ 0x3333u), quant::dither(i, ticks ^ 0xCCCCu)});
+}
+
+template <typename ParticleType>
+sf::Vector2f CompactParticles<ParticleType>::position(std::size_t index) const
+{
+    const Record& record = mRecords[index];
+    return {mCodec.decode(record.x, mCodec.origin.x), mCodec.decode(record.y, mCodec.origin.y)};
+}
+
+template <typename ParticleType>
+sf::Time CompactParticles<ParticleType>::lifetime(std::size_t index) const
+{
+    return mCodec.decode(mRecords[index].ticks);
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::kill(std::size_t index)
+{
+    mRecords[index].ticks = 0;
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::resize(std::size_t count)
+{
+    mRecords.resize(count);
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::reserve(std::size_t count)
+{
+    mRecords.reserve(count);
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::clear()
+{
+    mRecords.clear();
+}
+
+template <typename ParticleType>
+std::size_t CompactParticles<ParticleType>::size() const
+{
+    return mRecords.size();
+}
+
+template <typename ParticleType>
+bool CompactParticles<ParticleType>::empty() const
+{
+    return mRecords.empty();
+}
+
+template <typename ParticleType>
+std::size_t CompactParticles<ParticleType>::bytes() const
+{
+    return mRecords.capacity() * sizeof(Record);
+}
+
+template <typename ParticleType>
+void CompactParticles<ParticleType>::setCodec(quant::Codec const& codec)
+{
+    for (Record& record : mRecords)
+        record = pack(unpack(record, mCodec), codec);
+    mCodec = codec;
+}
+
+template <typename ParticleType>
+const quant::Codec& CompactParticles<ParticleType>::getCodec() const
+{
+    return mCodec;
+}
+
+template <typename ParticleType>
+auto CompactParticles<ParticleType>::records() -> std::vector<Record>&
+{
+    return mRecords;
+}
+
+template <typename ParticleType>
+auto CompactParticles<ParticleType>::records() const -> const std::vector<Record>&
+{
+    return mRecords;
+}
+
+template <typename ParticleType>
+CompactSpan<ParticleType>::CompactSpan(CompactParticles<ParticleType>& particles, std::size_t begin, std::size_t end)
+: mParticles(&particles)
+, mBegin(begin)
+, mEnd(end)
+{
+
+}
+
+template <typename ParticleType>
+const ParticleType CompactSpan<ParticleType>::operator[](std::size_t index) const
+{
+    return mParticles->get(mBegin + index);
+}
+
+template <typename ParticleType>
+ParticleType CompactSpan<ParticleType>::get(std::size_t index) const
+{
+    return mParticles->get(mBegin + index);
+}
+
+template <typename ParticleType>
+void CompactSpan<ParticleType>::set(std::size_t index, ParticleType const& particle) const
+{
+    mParticles->set(mBegin + index, particle);
+}
+
+template <typename ParticleType>
+std::size_t CompactSpan<ParticleType>::size() const
+{
+    return mEnd - mBegin;
+}
+
+template <typename ParticleType>
+std::size_t CompactSpan<ParticleType>::offset() const
+{
+    return mBegin;
+}
+
+namespace storage
+{
+    //particles [begin, end) as a chunk
+    template <typename ParticleType>
+    Span<ParticleType> slice(std::vector<ParticleType>& particles, std::size_t begin, std::size_t end)
+    {
+        return {particles.data() + begin, particles.data() + end};
+    }
+
+    template <typename ParticleType>
+    ColumnSpan<ParticleType> slice(ParticleColumns<ParticleType>& particles, std::size_t begin, std::size_t end)
+    {
+        return {particles, begin, end};
+    }
+
+    template <typename ParticleType>
+    CompactSpan<ParticleType> slice(CompactParticles<ParticleType>& particles, std::size_t begin, std::size_t end)
+    {
+        return {particles, begin, end};
+    }
+
+    //appends count copies of particle
+    template <typename ParticleType>
+    void append(std::vector<ParticleType>& particles, std::size_t count, ParticleType const& particle)
+    {
+        particles.insert(particles.end(), count, particle);
+    }
+
+    template <typename ParticleType>
+    void append(ParticleColumns<ParticleType>& particles, std::size_t count, ParticleType const& particle)
+    {
+        particles.append(count, particle);
+    }
+
+    template <typename ParticleType>
+    void append(CompactParticles<ParticleType>& particles, std::size_t count, ParticleType const& particle)
+    {
+        particles.append(count, particle);
+    }
+
+    //calls function(ParticleType&) for every particle of a chunk; SoA and Compact particles are gathered and scattered back
+    template <typename ParticleType, typename Function>
+    void forEachParticle(Span<ParticleType> chunk, Function&& function)
+    {
+        for (auto& particle : chunk)
+            function(particle);
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachParticle(ColumnSpan<ParticleType> chunk, Function&& function)
+    {
+        for (std::size_t i = 0; i < chunk.size(); ++i)
+        {
+            ParticleType particle = chunk.get(i);
+            function(particle);
+            chunk.set(i, particle);
+        }
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachParticle(CompactSpan<ParticleType> chunk, Function&& function)
+    {
+        for (std::size_t i = 0; i < chunk.size(); ++i)
+        {
+            ParticleType particle = chunk.get(i);
+            function(particle);
+            chunk.set(i, particle);
+        }
+    }
+
+    //calls function(std::vector<T>&) for every array the particles are kept in: one for AoS, one per column for SoA
+    template <typename ParticleType, typename Function>
+    void forEachColumn(std::vector<ParticleType>& particles, Function&& function)
+    {
+        function(particles);
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(std::vector<ParticleType> const& particles, Function&& function)
+    {
+        function(particles);
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(ParticleColumns<ParticleType>& particles, Function&& function)
+    {
+        particles.forEachColumn(std::forward<Function>(function));
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(ParticleColumns<ParticleType> const& particles, Function&& function)
+    {
+        particles.forEachColumn(std::forward<Function>(function));
+    }
+
+    //the packed records; they only mean the same particles to a container with the same codec
+    template <typename ParticleType, typename Function>
+    void forEachColumn(CompactParticles<ParticleType>& particles, Function&& function)
+    {
+        function(particles.records());
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(CompactParticles<ParticleType> const& particles, Function&& function)
+    {
+        function(particles.records());
+    }
+
+    //function(column, scratchColumn) for every array of particles and the same array of scratch
+    template <typename ParticleType, typename Function>
+    void forEachColumn(std::vector<ParticleType>& particles, std::vector<ParticleType>& scratch, Function&& function)
+    {
+        function(particles, scratch);
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(ParticleColumns<ParticleType>& particles, ParticleColumns<ParticleType>& scratch, Function&& function)
+    {
+        particles.forEachColumn(scratch, std::forward<Function>(function));
+    }
+
+    template <typename ParticleType, typename Function>
+    void forEachColumn(CompactParticles<ParticleType>& particles, CompactParticles<ParticleType>& scratch, Function&& function)
+    {
+        function(particles.records(), scratch.records());
+    }
+
+    //moves particle order[k] to slot k for every slot k listed in moved, the slots whose particle changes (order is a
+    //permutation that leaves every other slot as it is). Every column goes through the same column of scratch, which
+    //belongs to the caller (a pool thread waiting in forEach may run another reorder meanwhile): the particles that
+    //move are copied out, then written to their new slots, or when most of them move the whole column is copied and
+    //gathered back. forEach(count, task) calls task(begin, end) over chunks of [0, count) and may do so in parallel.
+    template <typename Container, typename ForEach>
+    void reorder(Container& particles, Container& scratch, const std::uint32_t* order, const std::uint32_t* moved, std::size_t count, ForEach const& forEach)
+    {
+        const bool gather = count * 2 > particles.size();
+        forEachColumn(particles, scratch, [order, moved, count, gather, &forEach](auto& column, auto& copy)
+        {
+            if (gather)
+            {
+                copy.assign(column.begin(), column.end());
+                forEach(column.size(), [&column, &copy, order](std::size_t begin, std::size_t end)
+                {
+                    for (std::size_t k = begin; k < end; ++k)
+                        column[k] = copy[order[k]];
+                });
+                return;
+            }
+            copy.resize(count);
+            forEach(count, [&column, &copy, order, moved](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t j = begin; j < end; ++j)
+                    copy[j] = column[order[moved[j]]];
+            });
+            forEach(count, [&column, &copy, moved](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t j = begin; j < end; ++j)
+                    column[moved[j]] = copy[j];
+            });
+        });
+    }
+
+    //a single member of particle index, e.g. value<&ParticleType::velocity>(particles, i), whatever the storage
+    template <auto Member, typename ParticleType>
+    decltype(auto) value(std::vector<ParticleType>& particles, std::size_t index)
+    {
+        return (particles[index].*Member);
+    }
+
+    template <auto Member, typename ParticleType>
+    decltype(auto) value(std::vector<ParticleType> const& particles, std::size_t index)
+    {
+        return (particles[index].*Member);
+    }
+
+    template <auto Member, typename ParticleType>
+    decltype(auto) value(ParticleColumns<ParticleType>& particles, std::size_t index)
+    {
+        return particles.template value<Member>(index);
+    }
+
+    template <auto Member, typename ParticleType>
+    decltype(auto) value(ParticleColumns<ParticleType> const& particles, std::size_t index)
+    {
+        return particles.template value<Member>(index);
+    }
+
+    //unpacked, so by value
+    template <auto Member, typename ParticleType>
+    auto value(CompactParticles<ParticleType> const& particles, std::size_t index)
+    {
+        return particles.get(index).*Member;
+    }
+
+    //memory reserved for particles
+    template <typename ParticleType>
+    std::size_t bytes(std::vector<ParticleType> const& particles)
+    {
+        return particles.capacity() * sizeof(ParticleType);
+    }
+
+    template <typename ParticleType>
+    std::size_t bytes(ParticleColumns<ParticleType> const& particles)
+    {
+        return particles.bytes();
+    }
+
+    template <typename ParticleType>
+    std::size_t bytes(CompactParticles<ParticleType> const& particles)
+    {
+        return particles.bytes();
+    }
+
+    //what removeExpired() calls for every particle it removes, by default nothing
+    struct IgnoreRemoved
+    {
+        void operator()(std::size_t) const {}
+    };
+
+    //what removeExpired() calls for every survivor it moves to another slot, by default nothing
+    struct IgnoreMoved
+    {
+        void operator()(std::size_t, std::size_t) const {}
+    };
+
+    //removes every particle whose lifetime ran out, returns how many were removed; removed(index) is called
+    //for each of them while it is still in place, moved(from, to) for every particle that takes another's slot,
+    //in the order the moves happen
+    template <typename ParticleType, typename Removed = IgnoreRemoved, typename Moved = IgnoreMoved>
+    std::size_t removeExpired(std::vector<ParticleType>& particles, Removal removal, Removed removed = {}, Moved moved = {})
+    {
+        const std::size_t count = particles.size();
+        if (removal == Removal::Ordered)
+        {
+            std::size_t alive = 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (particles[i].lifetime > sf::Time::Zero)
+                {
+                    if (alive != i)
+                    {
+                        particles[alive] = std::move(particles[i]);
+                        moved(i, alive);
+                    }
+                    ++alive;
+                }
+                else
+                    removed(i);
+            }
+            particles.erase(particles.begin() + alive, particles.end());
+        }
+        else
+        {
+            for (std::size_t i = 0; i < particles.size();)
+            {
+                if (particles[i].lifetime <= sf::Time::Zero)
+                {
+                    removed(i);
+                    if (i + 1 != particles.size())
+                    {
+                        particles[i] = std::move(particles.back());
+                        moved(particles.size() - 1, i);
+                    }
+                    particles.pop_back();
+                }
+                else
+                    ++i;
+            }
+        }
+        return count - particles.size();
+    }
+
+    template <typename ParticleType, typename Removed = IgnoreRemoved, typename Moved = IgnoreMoved>
+    std::size_t removeExpired(ParticleColumns<ParticleType>& particles, Removal removal, Removed removed = {}, Moved moved = {})
+    {
+        const auto& lifetimes = particles.lifetimes();
+        const std::size_t count = lifetimes.size();
+        std::size_t alive = 0;
+        if (removal == Removal::Ordered)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (lifetimes[i] > sf::Time::Zero)
+                {
+                    if (alive != i)
+                    {
+                        particles.move(i, alive);
+                        moved(i, alive);
+                    }
+                    ++alive;
+                }
+                else
+                    removed(i);
+            }
+        }
+        else
+        {
+            std::size_t end = count;
+            while (alive < end)
+            {
+                if (lifetimes[alive] <= sf::Time::Zero)
+                {
+                    removed(alive);
+                    if (--end != alive)
+                    {
+                        particles.move(end, alive);
+                        moved(end, alive);
+                    }
+                }
+                else
+                    ++alive;
+            }
+        }
+        if (alive != count)
+            particles.resize(alive);
+        return count - alive;
+    }
+
+    template <typename ParticleType, typename Removed = IgnoreRemoved, typename Moved = IgnoreMoved>
+    std::size_t removeExpired(CompactParticles<ParticleType>& particles, Removal removal, Removed removed = {}, Moved moved = {})
+    {
+        auto& records = particles.records();
+        const std::size_t count = records.size();
+        if (removal == Removal::Ordered)
+        {
+            std::size_t alive = 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (records[i].ticks != 0)
+                {
+                    if (alive != i)
+                    {
+                        records[alive] = records[i];
+                        moved(i, alive);
+                    }
+                    ++alive;
+                }
+                else
+                    removed(i);
+            }
+            records.erase(records.begin() + alive, records.end());
+        }
+        else
+        {
+            for (std::size_t i = 0; i < records.size();)
+            {
+                if (records[i].ticks == 0)
+                {
+                    removed(i);
+                    if (i + 1 != records.size())
+                    {
+                        records[i] = records.back();
+                        moved(records.size() - 1, i);
+                    }
+                    records.pop_back();
+                }
+                else
+                    ++i;
+            }
+        }
+        return count - records.size();
+    }
+
+    //reduces the lifetime of particles [begin, end) by dt, moving and turning them on the way if they integrate
+    //a velocity or an angular velocity (see attr::integrates_v)
+    template <typename ParticleType>
+    void age(std::vector<ParticleType>& particles, sf::Time dt, std::size_t begin, std::size_t end)
+    {
+        [[maybe_unused]] const float seconds = dt.asSeconds();
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            ParticleType& particle = particles[i];
+            particle.lifetime -= dt;
+            if constexpr (attr::integrates_velocity_v<ParticleType>)
+                particle.position += particle.velocity * seconds;
+            if constexpr (attr::integrates_angular_velocity_v<ParticleType>)
+                particle.rotation += particle.angularVelocity * seconds;
+        }
+    }
+
+    template <typename ParticleType>
+    void age(ParticleColumns<ParticleType>& particles, sf::Time dt, std::size_t begin, std::size_t end)
+    {
+        simd::subtractTime(particles.lifetimes().data() + begin, end - begin, dt);
+        [[maybe_unused]] const float seconds = dt.asSeconds();
+        if constexpr (attr::integrates_velocity_v<ParticleType>)
+        {
+            auto& positions = particles.positions();
+            for (std::size_t i = begin; i < end; ++i)
+                positions[i] += particles.template value<&ParticleType::velocity>(i) * seconds;
+        }
+        if constexpr (attr::integrates_angular_velocity_v<ParticleType>)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+                particles.template value<&ParticleType::rotation>(i) += particles.template value<&ParticleType::angularVelocity>(i) * seconds;
+        }
+    }
+
+    //dt is rarely a whole number of ticks, so every particle rounds it up or down at random with the odds that
+    //make it exact on average; positions moved by a velocity are rounded the same way
+    template <typename ParticleType>
+    void age(CompactParticles<ParticleType>& particles, sf::Time dt, std::size_t begin, std::size_t end)
+    {
+        const quant::Codec& codec = particles.getCodec();
+        const double ticks = static_cast<double>(dt.asMicroseconds()) / static_cast<double>(codec.tick.asMicroseconds());
+        const auto whole = static_cast<std::uint32_t>(ticks);
+        const auto fraction = static_cast<float>(ticks - whole);
+        auto& records = particles.records();
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            auto& record = records[i];
+            const std::uint32_t elapsed = whole + (quant::dither(static_cast<std::uint32_t>(i), record.ticks) < fraction);
+            if constexpr (attr::integrates_velocity_v<ParticleType> || attr::integrates_angular_velocity_v<ParticleType>)
+            {
+                ParticleType particle = particles.get(i);
+                const float seconds = dt.asSeconds();
+                if constexpr (attr::integrates_angular_velocity_v<ParticleType>)
+                    particle.rotation += particle.angularVelocity * seconds;
+                if constexpr (attr::integrates_velocity_v<ParticleType>)
+                    particle.position += particle.velocity * seconds;
+                using Mixin = typename CompactParticles<ParticleType>::Mixin;
+                static_cast<Mixin&>(record) = static_cast<Mixin const&>(particle);
+                if constexpr (attr::integrates_velocity_v<ParticleType>)
+                {
+                    record.x = codec.encode(particle.position.x, codec.origin.x, quant::dither(static_cast<std::uint32_t>(i), record.ticks ^ 0x5555u));
+                    record.y = codec.encode(particle.position.y, codec.origin.y, quant::dither(static_cast<std::uint32_t>(i), record.ticks ^ 0xAAAAu));
+                }
+            }
+            record.ticks = static_cast<std::uint16_t>(record.ticks > elapsed ? record.ticks - elapsed : 0);
+        }
+    }
+}
+
+#endif
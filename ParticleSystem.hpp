@@ -1,192 +1,1565 @@
 #ifndef PARTICLESYS_HPP
 #define PARTICLESYS_HPP
 
+#include "Access.hpp"
 #include "Particle.hpp"
+#include "ParticleStorage.hpp"
+#include "RadixSort.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+#include "SpatialGrid.hpp"
+#include "Stats.hpp"
+#include "Trails.hpp"
 
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/RenderStates.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/BlendMode.hpp>
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/Vertex.hpp>
 #include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/Graphics/VertexBuffer.hpp>
 
 #include <vector>
-#include <deque>
+#include <cmath>
 #include <functional>
+#include <algorithm>
+#include <memory>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <optional>
+#include <string>
+#include <type_traits>
 
 int getInt(int a, int b);
 
+class Scheduler;
+
 //TEMPLATE DECLARATION
-template <typename ParticleType = BaseParticle<>>
+template <typename ParticleType = BaseParticle<>, typename Storage = storage::AoS>
 class ParticleSystem : public sf::Drawable
 {
+public:
+    //std::vector<ParticleType> for storage::AoS, ParticleColumns<ParticleType> for storage::SoA
+    using Container = storage::container_t<ParticleType, Storage>;
+    //affector that only touches particles [begin, end) and may run on several sub-ranges at once
+    using ChunkAffector = std::function<void(Container &, std::size_t begin, std::size_t end)>;
+    //Span<ParticleType> for storage::AoS, ColumnSpan<ParticleType> for storage::SoA
+    using Chunk = storage::chunk_t<ParticleType, Storage>;
+    using Event = ParticleEvent<attr::payload_t<ParticleType>>;
+    //called once per update() with every event since the last one
+    using Listener = std::function<void(const std::vector<Event>&)>;
 public:
     ParticleSystem(sf::Texture &texture, sf::Color defaultColor, ParticleType particle);
+    //headless: quads of the given size and no texture, so no OpenGL context is ever needed
+    ParticleSystem(sf::Vector2f quadSize, sf::Color defaultColor, ParticleType particle);
     void addParticle();
     void addParticle(ParticleType const& particle);
     void addParticle(ParticleType&& particle);
-    void addAffector(std::function<void(std::deque<ParticleType> &)> affector);
+    void addParticles(std::size_t count, ParticleType const& particle);
+    template <typename Initializer>
+    void addParticles(std::size_t count, ParticleType const& particle, Initializer initializer);
+    template <typename Initializer>
+    void addParticles(std::size_t count, Initializer initializer);
+    void addAffector(std::function<void(Container &)> affector);
+    void addChunkAffector(ChunkAffector affector);
+    template <typename Function>
+    void addAffector(Function affector);
+    void setThreadPool(ThreadPool* pool);
+    void setChunkSize(std::size_t chunkSize);
     void setLifetime(sf::Time lifetime);
+    void setRemovalPolicy(storage::Removal removal);
+    void reserve(std::size_t count);
+    //hard limit on live particles, 0 for none; see storage::Admission
+    void setCapacity(std::size_t capacity, storage::Admission admission = storage::Admission::Drop);
     void addFinalizer(std::function<void(sf::VertexArray &)> finalizer);
+    //access is what the listener touches outside this system (e.g. the system a sub-emitter fills), for a Scheduler
+    void addDeathListener(Listener listener, sched::Access access = {});
+    void addSpawnListener(Listener listener, sched::Access access = {});
+    void setVertexBufferEnabled(bool enabled);
+    void setHistogramWindow(std::size_t frames);
+    void enableSpatialIndex(float cellSize);
+    void setCulling(bool enabled, bool chunkBounds = false);
+    void setCullRect(sf::FloatRect rect);
+    void setPreviousPositionsEnabled(bool enabled);
+    void setTextureRect(sf::FloatRect rect);
+    void setBlendMode(sf::BlendMode mode);
+    //draws a ribbon behind every particle through where it was after each of its last points updates; see Trails
+    void setTrail(std::size_t points, float width, unsigned subdivisions = 0);
+    //draws only about this fraction of the particles, spread evenly over them; 1 draws all
+    void setRenderFraction(float fraction);
+    //runs the affector (by the order they were added) only every interval-th update(); 1 runs it every time
+    void setAffectorInterval(std::size_t affector, unsigned interval);
+    //what the affector (by the order they were added) reads and writes, so that a Scheduler can run it alongside others
+    void setAffectorAccess(std::size_t affector, sched::Access access);
+    //state the finalizer shares with other systems' stages, for a Scheduler; its own system is always ordered before it
+    void setFinalizerAccess(std::size_t finalizer, sched::Access access);
+    //storage::Compact only: how positions and lifetimes are packed; particles already there are packed again
+    void setCodec(quant::Codec const& codec);
+    //replaces every particle: the storage is resized to count and fill(Container&) writes it in place
+    template <typename Function>
+    void assignParticles(std::size_t count, Function fill);
     void update(sf::Time dt);
 public:
     ParticleType getDefaultParticle() const;
     unsigned int getParticleCount() const;
+    std::size_t getCapacity() const;
+    const Container& getParticles() const;
+    const sf::VertexArray& getVertices() const;
+    const std::vector<sf::Vector2f>& getPreviousPositions() const;
+    const sf::Texture* getTexture() const;
+    sf::BlendMode getBlendMode() const;
+    float getRenderFraction() const;
+    const ParticleStats& getStats() const;
+    std::string exportHistograms() const;
+    const SpatialGrid& getSpatialIndex() const;
+    const Trails& getTrails() const;
 private:
+    struct Affector
+    {
+        //exactly one of them is set
+        Affector(std::function<void(Container &)> whole, ChunkAffector chunk)
+        : whole(std::move(whole))
+        , chunk(std::move(chunk))
+        {
+        }
+
+        std::function<void(Container &)> whole;
+        ChunkAffector chunk;
+        unsigned interval = 1;
+        unsigned wait = 0;      //updates to skip before the next run
+        bool due = true;        //runs in the current update()
+        std::optional<sched::Access> access;   //none: everything of the system
+    };
+private:
+    friend class Scheduler;
+    //the steps of update(), which a Scheduler runs as separate stages
+    void beginUpdate(sf::Time dt);
+    void age(sf::Time dt);
+    void runAffector(std::size_t affector);
+    void endUpdate();
+    std::size_t removeExpired();
+    void recordSpawns(std::size_t first, std::size_t count);
+    void trackBirths();
+    Event eventAt(std::size_t index, sf::Time age) const;
+    void deliverEvents();
+    void pushAffector(Affector affector);
+    void countSpawned(std::size_t count);
+    std::size_t admit(std::size_t count);
+    sf::Time lifetimeAt(std::size_t index) const;
+    void kill(std::size_t index);
+    void updateMemoryStats() const;
+    void rebuildSpatialIndex();
+    void recordTrails();
+    std::size_t quadsPerParticle() const;
+    void sortParticles();
+    template <typename Task>
+    void forEachChunk(Task const& task) const;
+    template <typename Task>
+    void forEachChunk(std::size_t count, Task const& task) const;
+    void updateCullRect(sf::RenderTarget const& target, sf::Transform const& transform) const;
+    sf::Vector2f reachAt(std::size_t index, sf::Vector2f half) const;
+    bool inCullRect(std::size_t index, sf::Vector2f position, sf::Vector2f half) const;
+    std::size_t cullChunks(sf::Vector2f half, bool cull, bool thin) const;
     void computeVertices() const;
-    void addVertex(float worldX, float worldY, float textX, float textY, sf::Color color) const;
     void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
 protected:
-    std::deque<ParticleType> mParticles;
+    Container mParticles;
     mutable sf::VertexArray mVertexArray;
+    mutable std::vector<std::uint8_t> mAlpha;
+    mutable std::unique_ptr<sf::VertexBuffer> mVertexBuffer;
+    bool mUseVertexBuffer = false;
 
-    std::vector<std::function<void(std::deque<ParticleType> &)>> mAffector;
+    std::vector<Affector> mAffector;
     std::vector<std::function<void(sf::VertexArray&)>> mFinalizer;
+    std::vector<sched::Access> mFinalizerAccess;
+    std::vector<Listener> mDeathListeners;
+    std::vector<Listener> mSpawnListeners;
+    sched::Access mListenerAccess;                    //of all listeners together
+    std::vector<Event> mDeaths;                       //since the last delivery, only gathered while someone listens
+    std::vector<Event> mSpawns;
+    std::vector<Event> mDelivering;                   //the events listeners are handed, so they can add and kill particles meanwhile
+    sf::Time mClock;                                  //time simulated since the system was created
+    std::vector<sf::Time> mBorn;                      //mClock when every particle was added, kept while there are death listeners
+    std::vector<sf::Time> mBornScratch;               //for sorting mBorn along
     
     mutable bool mNeedsUpdate = true;
+    mutable bool mVerticesChanged = true;
+    storage::Removal mRemoval = storage::Removal::Unordered;
+    std::size_t mCapacity = 0;  //0: unlimited
+    storage::Admission mAdmission = storage::Admission::Drop;
+    std::vector<sf::Time> mOldest; //scratch for ReplaceOldest, allocated by setCapacity()
+    ThreadPool* mThreadPool = nullptr;
+    std::size_t mChunkSize = 4096;
+    SpatialGrid mSpatialIndex;
+    std::vector<sf::Vector2f> mUnpacked;  //storage::Compact positions for the spatial index
+    float mSpatialCellSize = 0.f; //0 when there is no spatial index
+    RadixSort mSort;
+    std::vector<std::uint32_t> mSortKeys;   //sortKey as radix::key(), then where every particle went
+    Container mSortScratch;                 //the particles that move while sorting, see storage::reorder()
+    std::vector<sf::Vector2f> mPreviousScratch;
+
+    mutable ParticleStats mStats;
+    std::atomic<std::int64_t> mAgingTime{0};
+    std::size_t mKilled = 0;                             //by the current update()
+    std::deque<std::atomic<std::int64_t>> mAffectorTime; //one per affector, a deque because atomics can't be moved
+    mutable std::array<stats::Histogram, static_cast<std::size_t>(stats::Phase::Count)> mHistograms;
+    mutable std::size_t mVertexCapacity = 0;
+
+    enum class ChunkVisibility : std::uint8_t { Partial, Inside, Outside };
+    bool mCulling = false;
+    bool mChunkCulling = false;
+    mutable bool mHasCullRect = false;
+    mutable sf::FloatRect mCullRect;                  //visible area in particle coordinates, from the last draw()
+    mutable std::vector<std::size_t> mChunkOffset;    //first quad of every chunk in the culled vertex stream
+    mutable std::vector<ChunkVisibility> mChunkVisibility;
+
+    bool mTrackPrevious = false;
+    std::vector<sf::Vector2f> mPrevious;              //positions at the start of the last update(), by particle
+    mutable std::vector<sf::Vector2f> mQuadPrevious;  //the same, by quad
 
     sf::Color mDefaultColor;
     ParticleType mDefaultParticle;
-    sf::Texture &mTexture;
+    sf::Texture *mTexture;
+    sf::Vector2f mQuadSize;
+    sf::FloatRect mTextureRect;                       //empty: the whole texture
+    sf::BlendMode mBlendMode = sf::BlendAlpha;
+    Trails mTrails;                                   //empty (length 0) without trails
+    float mTrailWidth = 0.f;
+    unsigned mTrailSubdivisions = 0;
+    float mRenderFraction = 1.f;
+    std::uint32_t mRenderThreshold = 0;               //particle i is drawn if its Weyl sequence value i * golden ratio is below this
 };
 
 // TEMPLATE DEFINITIONS
 
-template <typename ParticleType>
-ParticleSystem<ParticleType>::ParticleSystem(sf::Texture &texture, sf::Color defaultColor, ParticleType particle)
-    : mTexture(texture), mVertexArray(sf::Quads), mDefaultParticle(particle), mDefaultColor(defaultColor)
+template <typename ParticleType, typename Storage>
+ParticleSystem<ParticleType, Storage>::ParticleSystem(sf::Texture &texture, sf::Color defaultColor, ParticleType particle)
+    : mTexture(&texture), mVertexArray(sf::Quads), mDefaultParticle(particle), mDefaultColor(defaultColor)
+{
+
+}
+
+template <typename ParticleType, typename Storage>
+ParticleSystem<ParticleType, Storage>::ParticleSystem(sf::Vector2f quadSize, sf::Color defaultColor, ParticleType particle)
+    : mTexture(nullptr), mQuadSize(quadSize), mVertexArray(sf::Quads), mDefaultParticle(particle), mDefaultColor(defaultColor)
+{
+
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addAffector(std::function<void(Container &)> affector)
+{
+    pushAffector({affector, nullptr});
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addChunkAffector(ChunkAffector affector)
+{
+    pushAffector({nullptr, affector});
+}
+
+//accepts any callable taking the whole Container&, a Chunk, (Container&, begin, end), or one ParticleType& (AoS only).
+//The last three run chunk by chunk, fused with neighbouring chunk affectors, and are only type-erased per chunk
+//so their per-particle body can be inlined.
+template <typename ParticleType, typename Storage>
+template <typename Function>
+void ParticleSystem<ParticleType, Storage>::addAffector(Function affector)
+{
+    if constexpr (std::is_invocable_v<Function&, Container &>)
+    {
+        pushAffector({std::move(affector), nullptr});
+    }
+    else if constexpr (std::is_invocable_v<Function&, Container &, std::size_t, std::size_t>)
+    {
+        pushAffector({nullptr, std::move(affector)});
+    }
+    else if constexpr (std::is_invocable_v<Function&, Chunk>)
+    {
+        pushAffector({nullptr, [affector](Container &particles, std::size_t begin, std::size_t end) mutable
+        {
+            affector(storage::slice(particles, begin, end));
+        }});
+    }
+    else
+    {
+        static_assert(std::is_same_v<Storage, storage::AoS> && std::is_invocable_v<Function&, ParticleType&>,
+            "an affector takes the whole container, a chunk, (container, begin, end), or a single particle with AoS storage");
+        pushAffector({nullptr, [affector](Container &particles, std::size_t begin, std::size_t end) mutable
+        {
+            for (auto &particle : storage::slice(particles, begin, end))
+                affector(particle);
+        }});
+    }
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::pushAffector(Affector affector)
+{
+    mAffector.push_back(std::move(affector));
+    mAffectorTime.emplace_back(0);
+    mStats.affector.resize(mAffector.size());
+}
+
+//with a pool, aging and chunk affectors are spread over its threads; nullptr runs everything on the caller
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setThreadPool(ThreadPool* pool)
+{
+    mThreadPool = pool;
+}
+
+//chunks are cut the same way with or without a pool, so results don't depend on the thread count
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setChunkSize(std::size_t chunkSize)
 {
+    mChunkSize = std::max<std::size_t>(chunkSize, 1);
+}
 
+//the task is handed to the pool by reference, so no std::function has to allocate for its captures
+template <typename ParticleType, typename Storage>
+template <typename Task>
+void ParticleSystem<ParticleType, Storage>::forEachChunk(Task const& task) const
+{
+    forEachChunk(mParticles.size(), task);
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::addAffector(std::function<void(std::deque<ParticleType> &)> affector)
+//the same over [0, count), for passes over something other than the particles
+template <typename ParticleType, typename Storage>
+template <typename Task>
+void ParticleSystem<ParticleType, Storage>::forEachChunk(std::size_t count, Task const& task) const
 {
-    mAffector.push_back(affector);
+    ThreadPool::run(mThreadPool, count, mChunkSize, std::cref(task));
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::addFinalizer(std::function<void(sf::VertexArray &)> finalizer)
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addFinalizer(std::function<void(sf::VertexArray &)> finalizer)
  {
     mFinalizer.push_back(finalizer);
+    mFinalizerAccess.emplace_back();
  }
-template<typename ParticleType>
-void ParticleSystem<ParticleType>::addParticle()
+
+//listeners see every particle that was removed (ran out of lifetime or was evicted for a new one) or added since
+//the last update(), batched at its end. Events are only gathered while there is a listener for them, and only then
+//does the system keep when every particle was added, for the age of its death.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addDeathListener(Listener listener, sched::Access access)
+{
+    //particles already there count their age from now on
+    if (mDeathListeners.empty())
+    {
+        mBorn.reserve(std::max(mCapacity, mParticles.size()));
+        mBorn.assign(mParticles.size(), mClock);
+    }
+    mDeathListeners.push_back(std::move(listener));
+    mListenerAccess.reads.insert(mListenerAccess.reads.end(), access.reads.begin(), access.reads.end());
+    mListenerAccess.writes.insert(mListenerAccess.writes.end(), access.writes.begin(), access.writes.end());
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addSpawnListener(Listener listener, sched::Access access)
+{
+    mSpawnListeners.push_back(std::move(listener));
+    mListenerAccess.reads.insert(mListenerAccess.reads.end(), access.reads.begin(), access.reads.end());
+    mListenerAccess.writes.insert(mListenerAccess.writes.end(), access.writes.begin(), access.writes.end());
+}
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addParticle()
 {
+    if (!admit(1))
+        return;
     mParticles.push_back(mDefaultParticle);
+    countSpawned(1);
+    recordSpawns(mParticles.size() - 1, 1);
 }
 
-template <typename ParticleType> 
-void ParticleSystem<ParticleType>::addParticle(ParticleType&& particle)
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addParticle(ParticleType&& particle)
 {
+    if (!admit(1))
+        return;
     mParticles.push_back(std::move(particle));
+    countSpawned(1);
+    recordSpawns(mParticles.size() - 1, 1);
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::addParticle(ParticleType const& particle)
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addParticle(ParticleType const& particle)
 {
+    if (!admit(1))
+        return;
     mParticles.push_back(particle);
+    countSpawned(1);
+    recordSpawns(mParticles.size() - 1, 1);
+}
+
+//appends count copies of particle with at most one allocation
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::addParticles(std::size_t count, ParticleType const& particle)
+{
+    count = admit(count);
+    storage::append(mParticles, count, particle);
+    countSpawned(count);
+    recordSpawns(mParticles.size() - count, count);
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::setLifetime(sf::Time lifetime)
+//appends count copies of particle, then hands the newborn particles to initializer as a single Chunk;
+//at capacity the chunk may hold fewer than count particles, or none
+template <typename ParticleType, typename Storage>
+template <typename Initializer>
+void ParticleSystem<ParticleType, Storage>::addParticles(std::size_t count, ParticleType const& particle, Initializer initializer)
+{
+    count = admit(count);
+    const std::size_t first = mParticles.size();
+    storage::append(mParticles, count, particle);
+    countSpawned(count);
+    if (count)
+        initializer(storage::slice(mParticles, first, first + count));
+    recordSpawns(first, count);
+}
+
+template <typename ParticleType, typename Storage>
+template <typename Initializer>
+void ParticleSystem<ParticleType, Storage>::addParticles(std::size_t count, Initializer initializer)
+{
+    addParticles(count, mDefaultParticle, std::move(initializer));
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::countSpawned(std::size_t count)
+{
+    if constexpr (stats::enabled)
+    {
+        mStats.spawned += count;
+        mStats.peak = std::max<std::size_t>(mStats.peak, mParticles.size());
+    }
+}
+
+//how many of count new particles fit, after evicting particles for them if the admission policy says so
+template <typename ParticleType, typename Storage>
+std::size_t ParticleSystem<ParticleType, Storage>::admit(std::size_t count)
+{
+    const std::size_t size = mParticles.size();
+    if (mCapacity == 0 || size + count <= mCapacity)
+        return count;
+
+    std::size_t evicted = 0;
+    bool dead = false;
+    if (mAdmission == storage::Admission::Thin)
+    {
+        //already dead particles make room without counting; of the live ones exactly as many as are still needed go,
+        //picked by selection sampling so that every set of them is as likely as any other
+        std::size_t live = 0;
+        for (std::size_t i = 0; i < size; ++i)
+            live += lifetimeAt(i) > sf::Time::Zero;
+        dead = live != size;
+        std::size_t needed = live + count > mCapacity ? std::min(live + count - mCapacity, live) : 0;
+        Rng& random = rng::local();
+        for (std::size_t i = 0, left = live; i < size && needed != 0; ++i)
+        {
+            if (lifetimeAt(i) <= sf::Time::Zero)
+                continue;
+            if (random.uniform(0u, static_cast<std::uint32_t>(left - 1)) < needed)
+            {
+                kill(i);
+                ++evicted;
+                --needed;
+            }
+            --left;
+        }
+    }
+    else if (mAdmission == storage::Admission::ReplaceOldest)
+    {
+        //already dead particles make room without counting, like with Thin; of the live ones the wanted-th smallest
+        //lifetime is the cut-off, and ties at the cut-off go until there are enough
+        mOldest.clear();
+        for (std::size_t i = 0; i < size; ++i)
+            if (lifetimeAt(i) > sf::Time::Zero)
+                mOldest.push_back(lifetimeAt(i));
+        const std::size_t live = mOldest.size();
+        dead = live != size;
+        const std::size_t wanted = live + count > mCapacity ? std::min(live + count - mCapacity, live) : 0;
+        sf::Time cutoff = sf::Time::Zero;
+        if (wanted)
+        {
+            std::nth_element(mOldest.begin(), mOldest.begin() + (wanted - 1), mOldest.end());
+            cutoff = mOldest[wanted - 1];
+        }
+        for (std::size_t i = 0; i < size && evicted < wanted; ++i)
+            if (lifetimeAt(i) > sf::Time::Zero && lifetimeAt(i) < cutoff)
+            {
+                kill(i);
+                ++evicted;
+            }
+        for (std::size_t i = 0; i < size && evicted < wanted; ++i)
+            if (lifetimeAt(i) == cutoff)
+            {
+                kill(i);
+                ++evicted;
+            }
+    }
+    //evicting is a pass over all particles, so adding in batches (like Emitter does) pays it once per batch;
+    //already dead particles that update() hasn't removed yet make room as well
+    if (evicted || dead)
+        removeExpired();
+
+    const std::size_t admitted = std::min(count, mCapacity - std::min(mCapacity, mParticles.size()));
+    if constexpr (stats::enabled)
+    {
+        mStats.dropped += count - admitted;
+        (mAdmission == storage::Admission::Thin ? mStats.thinned : mStats.replaced) += evicted;
+    }
+    return admitted;
+}
+
+template <typename ParticleType, typename Storage>
+sf::Time ParticleSystem<ParticleType, Storage>::lifetimeAt(std::size_t index) const
+{
+    if constexpr (std::is_same_v<Storage, storage::SoA>)
+        return mParticles.lifetimes()[index];
+    else if constexpr (std::is_same_v<Storage, storage::Compact>)
+        return mParticles.lifetime(index);
+    else
+        return mParticles[index].lifetime;
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::kill(std::size_t index)
+{
+    if constexpr (std::is_same_v<Storage, storage::SoA>)
+        mParticles.lifetimes()[index] = sf::Time::Zero;
+    else if constexpr (std::is_same_v<Storage, storage::Compact>)
+        mParticles.kill(index);
+    else
+        mParticles[index].lifetime = sf::Time::Zero;
+}
+
+//storage::removeExpired(), recording a death event for every removed particle while someone listens
+//and taking the trails of the survivors that move along
+template <typename ParticleType, typename Storage>
+std::size_t ParticleSystem<ParticleType, Storage>::removeExpired()
+{
+    const bool trails = mTrails.getLength() != 0;
+    if (trails)
+        mTrails.resize(mParticles.size());
+    const bool births = !mDeathListeners.empty();
+    if (births)
+        trackBirths();
+    auto moved = [this, trails, births](std::size_t from, std::size_t to)
+    {
+        if (trails)
+            mTrails.move(from, to);
+        if (births)
+            mBorn[to] = mBorn[from];
+    };
+    const std::size_t removed = !births ? storage::removeExpired(mParticles, mRemoval, storage::IgnoreRemoved(), moved)
+                              : storage::removeExpired(mParticles, mRemoval, [this](std::size_t index)
+    {
+        mDeaths.push_back(eventAt(index, mClock - mBorn[index]));
+    }, moved);
+    if (trails)
+        mTrails.resize(mParticles.size());
+    if (births)
+        mBorn.resize(mParticles.size());
+    return removed;
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::recordSpawns(std::size_t first, std::size_t count)
+{
+    if (!mDeathListeners.empty())
+        trackBirths();
+    if (mSpawnListeners.empty())
+        return;
+    for (std::size_t i = first; i < first + count; ++i)
+        mSpawns.push_back(eventAt(i, sf::Time::Zero));
+}
+
+//particles added since mBorn was last brought up to date, by the system or by an affector, are born now
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::trackBirths()
+{
+    mBorn.resize(mParticles.size(), mClock);
+}
+
+template <typename ParticleType, typename Storage>
+typename ParticleSystem<ParticleType, Storage>::Event ParticleSystem<ParticleType, Storage>::eventAt(std::size_t index, sf::Time age) const
+{
+    Event event;
+    if constexpr (std::is_same_v<Storage, storage::SoA>)
+        event.position = mParticles.positions()[index];
+    else if constexpr (std::is_same_v<Storage, storage::Compact>)
+        event.position = mParticles.position(index);
+    else
+        event.position = mParticles[index].position;
+    event.age = age;
+    if constexpr (attr::has_payload_v<ParticleType>)
+        event.payload = storage::value<&ParticleType::payload>(mParticles, index);
+    return event;
+}
+
+//listeners may add particles to this system, or kill some; whatever they cause is reported by the next update()
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::deliverEvents()
+{
+    if (!mDeaths.empty())
+    {
+        std::swap(mDeaths, mDelivering);
+        for (Listener& listener : mDeathListeners)
+            listener(mDelivering);
+        mDelivering.clear();
+    }
+    if (!mSpawns.empty())
+    {
+        std::swap(mSpawns, mDelivering);
+        for (Listener& listener : mSpawnListeners)
+            listener(mDelivering);
+        mDelivering.clear();
+    }
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setLifetime(sf::Time lifetime)
 {
     mDefaultParticle.lifetime = lifetime;
 }
 
-template <typename ParticleType>
-ParticleType ParticleSystem<ParticleType>::getDefaultParticle() const
+//draws through an sf::VertexBuffer with the Stream usage hint, so the GPU-side buffer is updated in place
+//instead of being rebuilt from the client-side array every frame; falls back to the array without VBO support
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setVertexBufferEnabled(bool enabled)
+{
+    mUseVertexBuffer = enabled;
+    if (!enabled)
+        mVertexBuffer.reset();
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setRemovalPolicy(storage::Removal removal)
+{
+    mRemoval = removal;
+}
+
+//preallocates room for count particles, dead particles' slots are reused so this is the only allocation needed
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::reserve(std::size_t count)
+{
+    mParticles.reserve(count);
+}
+
+//everything a full system needs is allocated here, once: particles, vertices and per-particle scratch,
+//so a system running at its capacity makes no further allocations
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setCapacity(std::size_t capacity, storage::Admission admission)
+{
+    mCapacity = capacity;
+    mAdmission = admission;
+    if (capacity == 0)
+        return;
+    mParticles.reserve(capacity);
+    const std::size_t quads = capacity * quadsPerParticle();
+    mVertexArray.resize(std::max(mVertexArray.getVertexCount(), quads * 4));
+    mVertexArray.resize(mParticles.size() * 4);
+    mVertexCapacity = std::max(mVertexCapacity, quads * 4);
+    mNeedsUpdate = true;
+    mAlpha.reserve(capacity);
+    if (mTrackPrevious)
+    {
+        mPrevious.reserve(capacity);
+        mQuadPrevious.reserve(quads);
+    }
+    if (mTrails.getLength() != 0)
+        mTrails.reserve(capacity);
+    if (admission == storage::Admission::ReplaceOldest)
+        mOldest.reserve(capacity);
+    if (!mDeathListeners.empty())
+        mBorn.reserve(capacity);
+    if constexpr (attr::has_sort_key_v<ParticleType>)
+        mSortKeys.reserve(capacity);
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setCodec(quant::Codec const& codec)
+{
+    static_assert(std::is_same_v<Storage, storage::Compact>, "only storage::Compact packs particles");
+    mParticles.setCodec(codec);
+    mNeedsUpdate = true;
+}
+
+template <typename ParticleType, typename Storage>
+std::size_t ParticleSystem<ParticleType, Storage>::getCapacity() const
+{
+    return mCapacity;
+}
+
+//keeps the last `frames` frames of every phase for exportHistograms(), 0 (the default) turns that off
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setHistogramWindow(std::size_t frames)
+{
+    for (auto& histogram : mHistograms)
+        histogram = stats::Histogram(frames);
+}
+
+//rebuilds a SpatialGrid of the particles' positions at the start of every update(), after the dead ones are
+//removed, so affectors can look up neighbours through getSpatialIndex(). The cell size should be about
+//the radius of the queries; 0 turns the index off again.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::enableSpatialIndex(float cellSize)
+{
+    mSpatialCellSize = std::max(cellSize, 0.f);
+    if (mSpatialCellSize == 0.f)
+        mSpatialIndex = SpatialGrid();
+}
+
+//leaves particles outside the render target's view out of the vertices (they are still simulated).
+//The view is the one of the last draw(), padded by half a quad, and getVertices() keeps to it as well.
+//With chunkBounds, every chunk's bounding box is tested first: chunks entirely off screen are skipped and
+//chunks entirely on screen are written without testing each particle.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setCulling(bool enabled, bool chunkBounds)
+{
+    mCulling = enabled;
+    mChunkCulling = enabled && chunkBounds;
+    mNeedsUpdate = true;
+}
+
+//culls against rect (in particle coordinates) instead of the view of the last draw(),
+//for systems that are never drawn directly, e.g. the one behind a SimulationThread
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setCullRect(sf::FloatRect rect)
+{
+    if (!mHasCullRect || rect != mCullRect)
+    {
+        mCullRect = rect;
+        mHasCullRect = true;
+        mNeedsUpdate = true;
+    }
+}
+
+//keeps where every particle was before the last update(), handed out per quad by getPreviousPositions()
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setPreviousPositionsEnabled(bool enabled)
+{
+    mTrackPrevious = enabled;
+    mNeedsUpdate = true;
+    if (!enabled)
+    {
+        mPrevious = std::vector<sf::Vector2f>();
+        mQuadPrevious = std::vector<sf::Vector2f>();
+    }
+}
+
+//one per quad of getVertices(): the particle's position before the last update(), for interpolating between two steps
+template <typename ParticleType, typename Storage>
+const std::vector<sf::Vector2f>& ParticleSystem<ParticleType, Storage>::getPreviousPositions() const
+{
+    getVertices();
+    return mQuadPrevious;
+}
+
+template <typename ParticleType, typename Storage>
+const sf::Texture* ParticleSystem<ParticleType, Storage>::getTexture() const
+{
+    return mTexture;
+}
+
+//draws every particle with this part of the texture (in pixels), e.g. one sprite of a sheet; quads take its size.
+//Particles with their own textureRect (see attr::has_texture_rect_v) ignore it.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setTextureRect(sf::FloatRect rect)
+{
+    mTextureRect = rect;
+    mNeedsUpdate = true;
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setBlendMode(sf::BlendMode mode)
+{
+    mBlendMode = mode;
+}
+
+//the ribbon is width wide at the particle and narrows and fades out towards its end. It runs through the particle's
+//positions after each of its last points updates, with subdivisions more points interpolated between every two of
+//them while the quads are built, so a fast particle draws a smooth curve without more points kept. Every particle
+//is then (points - 1) * (subdivisions + 1) quads more, in the particle's colour, drawn under its own quad; particles
+//added since the last update() have no trail yet. Culling is left off while trails are on, as a ribbon reaches into
+//the view from particles however far outside it. Fewer than 2 points turns trails off.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setTrail(std::size_t points, float width, unsigned subdivisions)
+{
+    points = points < 2 ? 0 : points;
+    if (points != mTrails.getLength())
+    {
+        if (points == 0)
+            mTrails = Trails();
+        else
+        {
+            mTrails.setLength(points);
+            mTrails.resize(mParticles.size());
+        }
+    }
+    mTrailWidth = width;
+    mTrailSubdivisions = subdivisions;
+    mNeedsUpdate = true;
+    //room for the trails of a full system as well
+    if (mCapacity != 0)
+        setCapacity(mCapacity, mAdmission);
+}
+
+template <typename ParticleType, typename Storage>
+const Trails& ParticleSystem<ParticleType, Storage>::getTrails() const
+{
+    return mTrails;
+}
+
+template <typename ParticleType, typename Storage>
+std::size_t ParticleSystem<ParticleType, Storage>::quadsPerParticle() const
+{
+    return 1 + Trails::quadCount(mTrails.getLength(), mTrailSubdivisions);
+}
+
+template <typename ParticleType, typename Storage>
+sf::BlendMode ParticleSystem<ParticleType, Storage>::getBlendMode() const
+{
+    return mBlendMode;
+}
+
+//which particles are left out depends on their index, so it can change as particles die
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setRenderFraction(float fraction)
+{
+    fraction = std::min(1.f, std::max(0.f, fraction));
+    if (fraction == mRenderFraction)
+        return;
+    mRenderFraction = fraction;
+    mRenderThreshold = static_cast<std::uint32_t>(static_cast<double>(fraction) * 4294967295.0);
+    mNeedsUpdate = true;
+}
+
+template <typename ParticleType, typename Storage>
+float ParticleSystem<ParticleType, Storage>::getRenderFraction() const
+{
+    return mRenderFraction;
+}
+
+//for affectors whose result doesn't depend on running every frame, e.g. steering from neighbours;
+//affectors with the same interval are spread over the updates by their index
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setAffectorInterval(std::size_t affector, unsigned interval)
+{
+    if (affector >= mAffector.size())
+        return;
+    Affector& entry = mAffector[affector];
+    interval = std::max(interval, 1u);
+    if (interval == entry.interval)
+        return;
+    entry.interval = interval;
+    entry.wait = std::min(entry.wait, static_cast<unsigned>(affector % entry.interval));
+}
+
+//a promise: the affector reads and writes nothing else, and neither adds nor removes particles
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setAffectorAccess(std::size_t affector, sched::Access access)
+{
+    if (affector < mAffector.size())
+        mAffector[affector].access = std::move(access);
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::setFinalizerAccess(std::size_t finalizer, sched::Access access)
+{
+    if (finalizer < mFinalizerAccess.size())
+        mFinalizerAccess[finalizer] = std::move(access);
+}
+
+//indices match the particles as they were before this frame's affectors ran; positions are that frame's too
+template <typename ParticleType, typename Storage>
+const SpatialGrid& ParticleSystem<ParticleType, Storage>::getSpatialIndex() const
+{
+    return mSpatialIndex;
+}
+
+//stable sort of the particles by sortKey, after the affectors so the order is that of the keys about to be drawn.
+//The particles stay sorted, so the next update() mostly finds them in order already and RadixSort only has to
+//place the few that moved past others, the ones added since and the ones Removal::Unordered moved.
+//Previous positions, trails and the spatial index are reordered along.
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::sortParticles()
+{
+    const std::size_t count = mParticles.size();
+    mSortKeys.resize(count);
+    forEachChunk([this](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            if constexpr (std::is_same_v<Storage, storage::Compact>)
+                mSortKeys[i] = radix::key(mParticles.records()[i].sortKey);
+            else
+                mSortKeys[i] = radix::key(storage::value<&ParticleType::sortKey>(mParticles, i));
+        }
+    });
+    if (!mSort.sort(mSortKeys.data(), count, mThreadPool, mChunkSize))
+        return;
+
+    const std::uint32_t* order = mSort.getOrder().data();
+    const std::vector<std::uint32_t>& moved = mSort.getMoved();
+    auto forEach = [this](std::size_t n, auto const& task) { forEachChunk(n, task); };
+    if (mTrackPrevious)
+    {
+        //particles an affector added have no previous position yet
+        for (std::size_t i = mPrevious.size(); i < count; ++i)
+        {
+            if constexpr (std::is_same_v<Storage, storage::SoA>)
+                mPrevious.push_back(mParticles.positions()[i]);
+            else
+                mPrevious.push_back(mParticles[i].position);
+        }
+        storage::reorder(mPrevious, mPreviousScratch, order, moved.data(), moved.size(), forEach);
+    }
+    storage::reorder(mParticles, mSortScratch, order, moved.data(), moved.size(), forEach);
+    if (!mDeathListeners.empty())
+    {
+        trackBirths();
+        storage::reorder(mBorn, mBornScratch, order, moved.data(), moved.size(), forEach);
+    }
+    if (mTrails.getLength() != 0)
+    {
+        mTrails.resize(count);
+        mTrails.reorder(order, moved.data(), moved.size(), mThreadPool, mChunkSize);
+    }
+    if (mSpatialCellSize > 0.f && !mSpatialIndex.empty())
+    {
+        forEachChunk([this, order](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t k = begin; k < end; ++k)
+                mSortKeys[order[k]] = static_cast<std::uint32_t>(k);
+        });
+        mSpatialIndex.renumber(mSortKeys.data(), mThreadPool, mChunkSize);
+    }
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::rebuildSpatialIndex()
+{
+    if (mParticles.empty())
+    {
+        mSpatialIndex.clear();
+        return;
+    }
+    if constexpr (std::is_same_v<Storage, storage::SoA>)
+    {
+        mSpatialIndex.build(mParticles.positions().data(), mParticles.size(), sizeof(sf::Vector2f), mSpatialCellSize, mThreadPool, mChunkSize);
+    }
+    else if constexpr (std::is_same_v<Storage, storage::Compact>)
+    {
+        mUnpacked.resize(mParticles.size());
+        for (std::size_t i = 0; i < mUnpacked.size(); ++i)
+            mUnpacked[i] = mParticles.position(i);
+        mSpatialIndex.build(mUnpacked.data(), mUnpacked.size(), sizeof(sf::Vector2f), mSpatialCellSize, mThreadPool, mChunkSize);
+    }
+    else
+        mSpatialIndex.build(&mParticles[0].position, mParticles.size(), sizeof(ParticleType), mSpatialCellSize, mThreadPool, mChunkSize);
+}
+
+//the positions after an update() become the newest point of every trail
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::recordTrails()
+{
+    mTrails.resize(mParticles.size());
+    if (mParticles.empty())
+        return;
+    if constexpr (std::is_same_v<Storage, storage::SoA>)
+    {
+        mTrails.record(mParticles.positions().data(), sizeof(sf::Vector2f), mThreadPool, mChunkSize);
+    }
+    else if constexpr (std::is_same_v<Storage, storage::Compact>)
+    {
+        mUnpacked.resize(mParticles.size());
+        forEachChunk([this](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+                mUnpacked[i] = mParticles.position(i);
+        });
+        mTrails.record(mUnpacked.data(), sizeof(sf::Vector2f), mThreadPool, mChunkSize);
+    }
+    else
+        mTrails.record(&mParticles[0].position, sizeof(ParticleType), mThreadPool, mChunkSize);
+}
+
+template <typename ParticleType, typename Storage>
+const ParticleStats& ParticleSystem<ParticleType, Storage>::getStats() const
+{
+    return mStats;
+}
+
+//{"aging": {...}, "affectors": {...}, ...}, see stats::Histogram::toJson()
+template <typename ParticleType, typename Storage>
+std::string ParticleSystem<ParticleType, Storage>::exportHistograms() const
+{
+    std::string json = "{";
+    for (std::size_t i = 0; i < mHistograms.size(); ++i)
+    {
+        json += i ? ", \"" : "\"";
+        json += stats::phaseName(static_cast<stats::Phase>(i));
+        json += "\": " + mHistograms[i].toJson();
+    }
+    return json + "}";
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::updateMemoryStats() const
+{
+    if constexpr (stats::enabled)
+        mStats.bytes = storage::bytes(mParticles) + mVertexCapacity * sizeof(sf::Vertex) + mAlpha.capacity() + mSpatialIndex.bytes()
+                     + mSort.bytes() + mSortKeys.capacity() * sizeof(std::uint32_t) + storage::bytes(mSortScratch)
+                     + mPreviousScratch.capacity() * sizeof(sf::Vector2f) + (mBorn.capacity() + mBornScratch.capacity()) * sizeof(sf::Time)
+                     + (mDeaths.capacity() + mSpawns.capacity() + mDelivering.capacity()) * sizeof(Event) + mTrails.bytes();
+}
+
+template <typename ParticleType, typename Storage>
+ParticleType ParticleSystem<ParticleType, Storage>::getDefaultParticle() const
 {
     return mDefaultParticle;
 }
 
-template <typename ParticleType>
-unsigned int ParticleSystem<ParticleType>::getParticleCount() const
+template <typename ParticleType, typename Storage>
+unsigned int ParticleSystem<ParticleType, Storage>::getParticleCount() const
 {
     return mParticles.size();
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::computeVertices() const
+template <typename ParticleType, typename Storage>
+auto ParticleSystem<ParticleType, Storage>::getParticles() const -> const Container&
+{
+    return mParticles;
+}
+
+template <typename ParticleType, typename Storage>
+template <typename Function>
+void ParticleSystem<ParticleType, Storage>::assignParticles(std::size_t count, Function fill)
+{
+    mParticles.clear();
+    mParticles.resize(count);
+    fill(mParticles);
+    if (mTrackPrevious)
+    {
+        mPrevious.resize(count);
+        if constexpr (std::is_same_v<Storage, storage::SoA>)
+            std::copy(mParticles.positions().begin(), mParticles.positions().end(), mPrevious.begin());
+        else
+            for (std::size_t i = 0; i < count; ++i)
+                mPrevious[i] = mParticles[i].position;
+    }
+    //the particles that were there took their trails with them
+    if (mTrails.getLength() != 0)
+    {
+        mTrails.clear();
+        mTrails.resize(count);
+    }
+    if (!mDeathListeners.empty())
+        mBorn.assign(count, mClock);
+    mNeedsUpdate = true;
+    countSpawned(count);
+}
+
+//the view's area (rotation included) taken back through the drawable's transform into particle coordinates
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::updateCullRect(sf::RenderTarget const& target, sf::Transform const& transform) const
 {
-    static int diff = 0;
+    const sf::FloatRect world = target.getView().getInverseTransform().transformRect({-1.f, -1.f, 2.f, 2.f});
+    const sf::FloatRect rect = transform.getInverse().transformRect(world);
+    if (!mHasCullRect || rect != mCullRect)
+    {
+        mCullRect = rect;
+        mHasCullRect = true;
+        mNeedsUpdate = true;
+    }
+}
+
+//how far the quad of particle index reaches past its position along either axis, whichever way it is turned;
+//half is that of the system's quad, for particles without a size or texture rect of their own
+template <typename ParticleType, typename Storage>
+sf::Vector2f ParticleSystem<ParticleType, Storage>::reachAt(std::size_t index, sf::Vector2f half) const
+{
+    sf::Vector2f extent = half;
+    if constexpr (attr::has_texture_rect_v<ParticleType>)
+    {
+        const sf::FloatRect tex = storage::value<&ParticleType::textureRect>(mParticles, index);
+        extent = {tex.width / 2.f, tex.height / 2.f};
+    }
+    if constexpr (attr::has_size_v<ParticleType>)
+    {
+        const auto size = storage::value<&ParticleType::size>(mParticles, index);
+        if constexpr (std::is_arithmetic_v<decltype(size)>)
+            extent = {size / 2.f, size / 2.f};
+        else
+            extent = sf::Vector2f(size) / 2.f;
+    }
+    extent = {std::abs(extent.x), std::abs(extent.y)};
+    //a turned quad stays within the circle through its corners
+    if constexpr (attr::has_rotation_v<ParticleType>)
+    {
+        const float radius = std::hypot(extent.x, extent.y);
+        extent = {radius, radius};
+    }
+    return extent;
+}
 
-    sf::Vector2f size(mTexture.getSize());
-    sf::Vector2f half = size / 2.f;
+//whether the quad of particle index at position can reach into the cull rect
+template <typename ParticleType, typename Storage>
+bool ParticleSystem<ParticleType, Storage>::inCullRect(std::size_t index, sf::Vector2f position, sf::Vector2f half) const
+{
+    const sf::Vector2f reach = reachAt(index, half);
+    return position.x + reach.x >= mCullRect.left && position.x - reach.x <= mCullRect.left + mCullRect.width
+        && position.y + reach.y >= mCullRect.top && position.y - reach.y <= mCullRect.top + mCullRect.height;
+}
 
-    mVertexArray.clear();
+//counts the visible particles of every chunk into mChunkOffset and turns the counts into offsets, returns the total
+template <typename ParticleType, typename Storage>
+std::size_t ParticleSystem<ParticleType, Storage>::cullChunks(sf::Vector2f half, bool cull, bool thin) const
+{
+    const std::size_t count = mParticles.size();
+    const std::size_t chunks = (count + mChunkSize - 1) / mChunkSize;
+    mChunkOffset.assign(chunks + 1, 0);
+    mChunkVisibility.assign(chunks, ChunkVisibility::Partial);
+    const float right = mCullRect.left + mCullRect.width;
+    const float bottom = mCullRect.top + mCullRect.height;
 
-    for (const auto &particle : mParticles)
+    forEachChunk([this, half, right, bottom, cull, thin](std::size_t begin, std::size_t end)
     {
-        sf::Vector2f pos = particle.position;
-        sf::Color c;
-        if constexpr(attr::has_color_v<ParticleType>)
+        auto position = [this](std::size_t i) -> sf::Vector2f
+        {
+            if constexpr (std::is_same_v<Storage, storage::SoA>)
+                return mParticles.positions()[i];
+            else if constexpr (std::is_same_v<Storage, storage::Compact>)
+                return mParticles.position(i);
+            else
+                return mParticles[i].position;
+        };
+        const std::size_t chunk = begin / mChunkSize;
+        if (cull && mChunkCulling)
         {
-            c = particle.color;
+            //every quad reaches between least and most past its position
+            constexpr bool sized = attr::has_size_v<ParticleType> || attr::has_texture_rect_v<ParticleType>;
+            sf::Vector2f low = position(begin), high = low;
+            sf::Vector2f least = reachAt(begin, half), most = least;
+            for (std::size_t i = begin + 1; i < end; ++i)
+            {
+                const sf::Vector2f p = position(i);
+                low.x = std::min(low.x, p.x);
+                low.y = std::min(low.y, p.y);
+                high.x = std::max(high.x, p.x);
+                high.y = std::max(high.y, p.y);
+                if constexpr (sized)
+                {
+                    const sf::Vector2f reach = reachAt(i, half);
+                    least.x = std::min(least.x, reach.x);
+                    least.y = std::min(least.y, reach.y);
+                    most.x = std::max(most.x, reach.x);
+                    most.y = std::max(most.y, reach.y);
+                }
+            }
+            if (high.x + most.x < mCullRect.left || low.x - most.x > right || high.y + most.y < mCullRect.top || low.y - most.y > bottom)
+            {
+                mChunkVisibility[chunk] = ChunkVisibility::Outside;
+                return;
+            }
+            if (!thin && low.x + least.x >= mCullRect.left && high.x - least.x <= right
+                      && low.y + least.y >= mCullRect.top && high.y - least.y <= bottom)
+            {
+                mChunkVisibility[chunk] = ChunkVisibility::Inside;
+                mChunkOffset[chunk + 1] = end - begin;
+                return;
+            }
         }
-        else 
+        std::size_t visible = 0;
+        for (std::size_t i = begin; i < end; ++i)
         {
-            c = mDefaultColor;
-            const float ratio = particle.lifetime.asSeconds() / mDefaultParticle.lifetime.asSeconds();
-            c.a = static_cast<uint8_t>(255 * std::max(0.0f, ratio)); //can't forget to keep the alpha value positive
+            visible += (!cull || inCullRect(i, position(i), half))
+                       && (!thin || static_cast<std::uint32_t>(i * 2654435769u) < mRenderThreshold);
         }
-        
-        addVertex(pos.x - half.x, pos.y - half.y, 0.f, 0.f, c);
-        addVertex(pos.x + half.x, pos.y - half.y, size.x, 0.f, c);
-        addVertex(pos.x + half.x, pos.y + half.y, size.x, size.y, c);
-        addVertex(pos.x - half.x, pos.y + half.y, 0.f, size.y, c);
+        mChunkOffset[chunk + 1] = visible;
+    });
+
+    for (std::size_t c = 0; c < chunks; ++c)
+        mChunkOffset[c + 1] += mChunkOffset[c];
+    return mChunkOffset[chunks];
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::computeVertices() const
+{
+    const sf::FloatRect texture = mTextureRect.width != 0.f && mTextureRect.height != 0.f ? mTextureRect
+                                : sf::FloatRect({0.f, 0.f}, mTexture ? sf::Vector2f(mTexture->getSize()) : mQuadSize);
+    const sf::Vector2f size = mTexture || mTextureRect.width != 0.f ? sf::Vector2f(texture.width, texture.height) : mQuadSize;
+    const sf::Vector2f half = size / 2.f;
+    const std::size_t count = mParticles.size();
+
+    //a particle is culled once its quad can't reach into the view, by its own size where it has one;
+    //trails reach arbitrarily far from their particle, so they turn culling off
+    //thinning leaves particles out the same way, so it shares the culling path
+    const bool inView = mCulling && mHasCullRect && mTrails.getLength() == 0;
+    const bool thin = mRenderFraction < 1.f;
+    const bool cull = inView || thin;
+    const std::size_t visible = cull && count ? cullChunks(half, inView, thin) : count;
+    if constexpr (stats::enabled)
+        mStats.culled = count - visible;
+
+    //sized from the particle count and rewritten in place every frame, shrinking keeps the capacity around
+    //a particle with a trail is its trail's quads, then its own
+    const std::size_t per = quadsPerParticle();
+    const std::size_t trailQuads = per - 1;
+    mVertexArray.resize(visible * per * 4);
+    mVertexCapacity = std::max(mVertexCapacity, visible * per * 4);
+    if (visible == 0)
+        return;
+    sf::Vertex* vertices = &mVertexArray[0];
+    if constexpr (std::is_same_v<Storage, storage::SoA> && attr::fades_v<ParticleType>)
+        mAlpha.resize(count);
+    if (mTrackPrevious)
+        mQuadPrevious.resize(visible * per);
+
+    //every chunk writes its own quads, so chunks can be built in parallel; culled chunks start at their offset
+    forEachChunk([this, vertices, texture, half, cull, inView, thin, per, trailQuads](std::size_t begin, std::size_t end)
+    {
+        const std::size_t chunk = begin / mChunkSize;
+        if (cull && mChunkVisibility[chunk] == ChunkVisibility::Outside)
+            return;
+        const bool test = cull && mChunkVisibility[chunk] == ChunkVisibility::Partial;
+
+        sf::Vertex* quad = vertices + 4 * per * (cull ? mChunkOffset[chunk] : begin);
+        auto writeQuad = [this, vertices, &quad, texture, half, test, inView, thin, trailQuads](std::size_t i, sf::Vector2f pos, sf::Color c)
+        {
+            if (test && inView && !inCullRect(i, pos, half))
+                return;
+            if (test && thin && static_cast<std::uint32_t>(i * 2654435769u) >= mRenderThreshold)
+                return;
+            //particles added since the last update() have no previous position yet
+            const sf::Vector2f previous = mTrackPrevious && i < mPrevious.size() ? mPrevious[i] : pos;
+            if (trailQuads)
+            {
+                mTrails.writeRibbon(i, pos, c, mTrailWidth, mTrailSubdivisions, texture, quad);
+                //the trail is shifted back along with its particle
+                if (mTrackPrevious)
+                    for (std::size_t q = 0; q < trailQuads; ++q)
+                    {
+                        const sf::Vertex* trail = quad + 4 * q;
+                        mQuadPrevious[(trail - vertices) / 4] = (trail[0].position + trail[2].position) / 2.f + (previous - pos);
+                    }
+                quad += 4 * trailQuads;
+            }
+            if (mTrackPrevious)
+                mQuadPrevious[(quad - vertices) / 4] = previous;
+            //only the attributes the particle type carries are compiled in
+            sf::FloatRect tex = texture;
+            sf::Vector2f extent = half;
+            if constexpr (attr::has_texture_rect_v<ParticleType>)
+            {
+                tex = storage::value<&ParticleType::textureRect>(mParticles, i);
+                extent = {tex.width / 2.f, tex.height / 2.f};
+            }
+            if constexpr (attr::has_size_v<ParticleType>)
+            {
+                const auto size = storage::value<&ParticleType::size>(mParticles, i);
+                if constexpr (std::is_arithmetic_v<decltype(size)>)
+                    extent = {size / 2.f, size / 2.f};
+                else
+                    extent = sf::Vector2f(size) / 2.f;
+            }
+            const float u = tex.left + tex.width, v = tex.top + tex.height;
+            if constexpr (attr::has_rotation_v<ParticleType>)
+            {
+                const float angle = storage::value<&ParticleType::rotation>(mParticles, i) * 0.017453292f;
+                const float cosine = std::cos(angle), sine = std::sin(angle);
+                const sf::Vector2f x(extent.x * cosine, extent.x * sine), y(-extent.y * sine, extent.y * cosine);
+                quad[0] = sf::Vertex(pos - x - y, c, {tex.left, tex.top});
+                quad[1] = sf::Vertex(pos + x - y, c, {u, tex.top});
+                quad[2] = sf::Vertex(pos + x + y, c, {u, v});
+                quad[3] = sf::Vertex(pos - x + y, c, {tex.left, v});
+            }
+            else
+            {
+                quad[0] = sf::Vertex({pos.x - extent.x, pos.y - extent.y}, c, {tex.left, tex.top});
+                quad[1] = sf::Vertex({pos.x + extent.x, pos.y - extent.y}, c, {u, tex.top});
+                quad[2] = sf::Vertex({pos.x + extent.x, pos.y + extent.y}, c, {u, v});
+                quad[3] = sf::Vertex({pos.x - extent.x, pos.y + extent.y}, c, {tex.left, v});
+            }
+            quad += 4;
+        };
+        if constexpr (std::is_same_v<Storage, storage::SoA>)
+        {
+            const auto& positions = mParticles.positions();
+            if constexpr(attr::has_color_v<ParticleType>)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                    writeQuad(i, positions[i], mParticles.template value<&ParticleType::color>(i));
+            }
+            else if constexpr(!attr::fades_v<ParticleType>)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                    writeQuad(i, positions[i], mDefaultColor);
+            }
+            else
+            {
+                //alpha for the whole chunk in one vectorized pass
+                simd::lifetimeAlpha(mParticles.lifetimes().data() + begin, end - begin, mDefaultParticle.lifetime, mAlpha.data() + begin);
+                sf::Color c = mDefaultColor;
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    c.a = mAlpha[i];
+                    writeQuad(i, positions[i], c);
+                }
+            }
+        }
+        else
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const auto &particle = mParticles[i];
+                if constexpr(attr::has_color_v<ParticleType>)
+                {
+                    writeQuad(i, particle.position, particle.color);
+                }
+                else if constexpr(!attr::fades_v<ParticleType>)
+                {
+                    writeQuad(i, particle.position, mDefaultColor);
+                }
+                else
+                {
+                    sf::Color c = mDefaultColor;
+                    const float ratio = particle.lifetime.asSeconds() / mDefaultParticle.lifetime.asSeconds();
+                    c.a = static_cast<uint8_t>(255 * std::max(0.0f, ratio)); //can't forget to keep the alpha value positive
+                    writeQuad(i, particle.position, c);
+                }
+            }
+        }
+    });
+}
+
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::update(sf::Time dt)
+{
+    beginUpdate(dt);
+
+    //consecutive chunk affectors are fused: every one of them runs on a block before the next block is touched,
+    //so a block is pulled into cache once per run instead of once per affector. Aging rides along with the first run.
+    bool aged = false;
+    std::size_t next = 0;
+    while (next < mAffector.size() || !aged)
+    {
+        if (next < mAffector.size() && !mAffector[next].chunk)
+        {
+            if (!aged)
+            {
+                age(dt);
+                aged = true;
+            }
+            runAffector(next++);
+            continue;
+        }
+
+        std::size_t last = next;
+        while (last < mAffector.size() && mAffector[last].chunk)
+            ++last;
+        const bool age = !aged;
+        forEachChunk([this, dt, age, next, last](std::size_t begin, std::size_t end)
+        {
+            //reduce time elapsed from particles' lifetime
+            std::int64_t start = stats::now();
+            if (age)
+            {
+                storage::age(mParticles, dt, begin, end);
+                stats::accumulate(mAgingTime, start);
+            }
+            for (std::size_t i = next; i < last; ++i)
+            {
+                if (!mAffector[i].due)
+                    continue;
+                start = stats::now();
+                mAffector[i].chunk(mParticles, begin, end);
+                stats::accumulate(mAffectorTime[i], start);
+            }
+        });
+        aged = true;
+        next = last;
     }
 
-    if (diff != mParticles.size())
+    endUpdate();
+}
+
+//everything update() does before aging: dead particles are removed and the spatial index rebuilt
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::beginUpdate(sf::Time dt)
+{
+    std::int64_t start = stats::now();
+    mAgingTime.store(0, std::memory_order_relaxed);
+    for (auto& time : mAffectorTime)
+        time.store(0, std::memory_order_relaxed);
+
+    //remove all expired particles, the ones that died of the last update's aging
+    mKilled = removeExpired();
+    mClock += dt;
+    stats::accumulate(mAgingTime, start);
+
+    if (mTrackPrevious)
     {
-        std::cout << mParticles.size() << " " << mVertexArray.getVertexCount() << std::endl;
-        diff = mParticles.size();
+        mPrevious.resize(mParticles.size());
+        if constexpr (std::is_same_v<Storage, storage::SoA>)
+            std::copy(mParticles.positions().begin(), mParticles.positions().end(), mPrevious.begin());
+        else
+            for (std::size_t i = 0; i < mParticles.size(); ++i)
+                mPrevious[i] = mParticles[i].position;
+    }
+
+    if (mSpatialCellSize > 0.f)
+    {
+        start = stats::now();
+        rebuildSpatialIndex();
+        if constexpr (stats::enabled)
+            mStats.spatialIndex = stats::toTime(stats::now() - start);
+    }
+
+    mNeedsUpdate = true;
+
+    for (Affector& affector : mAffector)
+    {
+        affector.due = affector.wait == 0;
+        affector.wait = affector.due ? affector.interval - 1 : affector.wait - 1;
     }
 }
 
-//need to be fixed
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::addVertex(float worldX, float worldY, float textX, float textY, sf::Color color) const
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::age(sf::Time dt)
 {
-    sf::Vertex tempVertex;
-    tempVertex.color = color;
-    tempVertex.position = {worldX, worldY};
-    tempVertex.texCoords = {textX, textY};
-    mVertexArray.append(tempVertex);
+    const std::int64_t start = stats::now();
+    forEachChunk([this, dt](std::size_t begin, std::size_t end) { storage::age(mParticles, dt, begin, end); });
+    stats::accumulate(mAgingTime, start);
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::update(sf::Time dt)
+//one affector on its own, chunk by chunk if it is a chunk affector; nothing if it isn't due
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::runAffector(std::size_t affector)
 {
-    //remove all expired particles
-    while (!mParticles.empty() && mParticles.front().lifetime <= sf::Time::Zero)
-        mParticles.pop_front();
+    Affector& entry = mAffector[affector];
+    if (entry.chunk)
+    {
+        if (!entry.due)
+            return;
+        forEachChunk([this, &entry, affector](std::size_t begin, std::size_t end)
+        {
+            const std::int64_t start = stats::now();
+            entry.chunk(mParticles, begin, end);
+            stats::accumulate(mAffectorTime[affector], start);
+        });
+        return;
+    }
+    const std::int64_t start = stats::now();
+    if (entry.due)
+        entry.whole(mParticles);
+    stats::accumulate(mAffectorTime[affector], start);
+}
 
-    //reduce time elapsed from particles' lifetime
-    for (auto &particle : mParticles)
+//everything update() does after the affectors: sorting, trails, stats and events
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::endUpdate()
+{
+    if constexpr (attr::has_sort_key_v<ParticleType>)
     {
-        particle.lifetime -= dt;
+        const std::int64_t start = stats::now();
+        sortParticles();
+        if constexpr (stats::enabled)
+        {
+            mStats.sort = stats::toTime(stats::now() - start);
+            mHistograms[static_cast<std::size_t>(stats::Phase::Sort)].add(mStats.sort);
+        }
     }
+    if (mTrails.getLength() != 0)
+        recordTrails();
 
-    mNeedsUpdate = true;
+    if constexpr (stats::enabled)
+    {
+        mStats.killed += mKilled;
+        mStats.aging = stats::toTime(mAgingTime.load(std::memory_order_relaxed));
+        mStats.affectors = sf::Time::Zero;
+        for (std::size_t i = 0; i < mAffector.size(); ++i)
+        {
+            mStats.affector[i] = stats::toTime(mAffectorTime[i].load(std::memory_order_relaxed));
+            mStats.affectors += mStats.affector[i];
+        }
+        mHistograms[static_cast<std::size_t>(stats::Phase::Aging)].add(mStats.aging);
+        mHistograms[static_cast<std::size_t>(stats::Phase::Affectors)].add(mStats.affectors);
+        updateMemoryStats();
+    }
 
-    for (auto &affector : mAffector)
-        affector(mParticles);
+    deliverEvents();
 }
 
-template <typename ParticleType>
-void ParticleSystem<ParticleType>::draw(sf::RenderTarget &target, sf::RenderStates states) const
+//the quads as they will be drawn, rebuilt (and run through the finalizers) if the particles changed since
+template <typename ParticleType, typename Storage>
+const sf::VertexArray& ParticleSystem<ParticleType, Storage>::getVertices() const
 {
     if (mNeedsUpdate)
     {
+        std::int64_t start = stats::now();
         computeVertices();
+        const std::int64_t built = stats::now();
         for(auto& finalizer : mFinalizer)
             finalizer(mVertexArray);
         mNeedsUpdate = false;
+        mVerticesChanged = true;
+
+        if constexpr (stats::enabled)
+        {
+            mStats.vertices = stats::toTime(built - start);
+            mStats.finalizers = stats::toTime(stats::now() - built);
+            mHistograms[static_cast<std::size_t>(stats::Phase::Vertices)].add(mStats.vertices);
+            mHistograms[static_cast<std::size_t>(stats::Phase::Finalizers)].add(mStats.finalizers);
+            updateMemoryStats();
+        }
     }
+    return mVertexArray;
+}
 
-    states.texture = &mTexture;
-    target.draw(mVertexArray, states);
+template <typename ParticleType, typename Storage>
+void ParticleSystem<ParticleType, Storage>::draw(sf::RenderTarget &target, sf::RenderStates states) const
+{
+    if (mCulling)
+        updateCullRect(target, states.transform);
+    getVertices();
+
+    const std::int64_t start = stats::now();
+    states.texture = mTexture;
+    states.blendMode = mBlendMode;
+    if (mUseVertexBuffer && sf::VertexBuffer::isAvailable())
+    {
+        const std::size_t count = mVertexArray.getVertexCount();
+        if (!mVertexBuffer)
+            mVertexBuffer = std::make_unique<sf::VertexBuffer>(sf::Quads, sf::VertexBuffer::Stream);
+        //grow with some headroom so a slowly rising particle count doesn't reallocate every frame
+        if (mVertexBuffer->getVertexCount() < count)
+        {
+            mVertexBuffer->create(count + count / 2);
+            mVerticesChanged = true;
+        }
+        if (count != 0)
+        {
+            if (mVerticesChanged)
+                mVertexBuffer->update(&mVertexArray[0], count, 0);
+            target.draw(*mVertexBuffer, 0, count, states);
+        }
+    }
+    else
+    {
+        target.draw(mVertexArray, states);
+    }
+    mVerticesChanged = false;
+
+    if constexpr (stats::enabled)
+    {
+        mStats.draw = stats::toTime(stats::now() - start);
+        mHistograms[static_cast<std::size_t>(stats::Phase::Draw)].add(mStats.draw);
+    }
 }
 
 #endif
@@ -0,0 +1,117 @@
+#include "QualityController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    //how much of a change in cost the smoothed cost follows per update, going up and going down
+    const float kAttack = 0.5f;
+    const float kRelease = 0.05f;
+    //no change while the cost is between (1 - kHeadroom) * budget and the budget
+    const float kHeadroom = 0.15f;
+    //share of the overshoot the level gives up per update, and level gained per update with room to spare;
+    //both small because emission only changes the cost once the particles it adds or spares have lived out
+    const float kBackOff = 0.2f;
+    const float kRecovery = 0.002f;
+}
+
+QualityController::QualityController(sf::Time budget)
+: mBudget(budget)
+{
+
+}
+
+void QualityController::clear()
+{
+    mEffects.clear();
+    mLevel = 1.f;
+    mSmoothed = 0.f;
+}
+
+void QualityController::setBudget(sf::Time budget)
+{
+    mBudget = budget;
+}
+
+sf::Time QualityController::getBudget() const
+{
+    return mBudget;
+}
+
+void QualityController::setMinimumQuality(float quality)
+{
+    mMinimum = std::min(1.f, std::max(quality, 0.001f));
+    mLevel = std::max(mLevel, mMinimum);
+}
+
+void QualityController::setBaseEmissionRate(std::size_t effect, float rate)
+{
+    if (effect >= mEffects.size())
+        return;
+    mEffects[effect].baseRate = rate;
+    apply(mEffects[effect]);
+}
+
+void QualityController::update()
+{
+    sf::Time cost;
+    for (Effect const& effect : mEffects)
+        cost += effect.cost();
+    update(cost);
+}
+
+void QualityController::update(sf::Time measured)
+{
+    const float cost = measured.asSeconds();
+    mSmoothed += (cost - mSmoothed) * (cost > mSmoothed ? kAttack : kRelease);
+
+    const float budget = mBudget.asSeconds();
+    if (budget > 0.f && mSmoothed > budget)
+    {
+        //back off in proportion to the overshoot
+        const float ratio = budget / mSmoothed;
+        mLevel *= 1.f - kBackOff * (1.f - ratio);
+    }
+    else if (mSmoothed < budget * (1.f - kHeadroom))
+    {
+        mLevel += kRecovery;
+    }
+    mLevel = std::min(1.f, std::max(mMinimum, mLevel));
+
+    for (Effect& effect : mEffects)
+    {
+        effect.quality = std::max(mMinimum, std::pow(mLevel, 1.f / std::max(effect.priority, 0.001f)));
+        apply(effect);
+    }
+}
+
+void QualityController::apply(Effect& effect)
+{
+    const float quality = effect.quality;
+    if (effect.setEmissionRate)
+        effect.setEmissionRate(effect.baseRate * quality);
+    effect.setRenderFraction(std::min(1.f, 2.f * quality));
+    effect.setAffectorInterval(quality < 0.125f ? 4u : quality < 0.25f ? 2u : 1u);
+}
+
+std::size_t QualityController::push(Effect effect)
+{
+    mEffects.push_back(std::move(effect));
+    return mEffects.size() - 1;
+}
+
+float QualityController::getLevel() const
+{
+    return mLevel;
+}
+
+float QualityController::getQuality(std::size_t effect) const
+{
+    return effect < mEffects.size() ? mEffects[effect].quality : 1.f;
+}
+
+sf::Time QualityController::getSmoothedCost() const
+{
+    return sf::seconds(mSmoothed);
+}
@@ -0,0 +1,109 @@
+#ifndef QUALITYCONTROLLER_HPP
+#define QUALITYCONTROLLER_HPP
+
+#include "Emitter.hpp"
+#include "ParticleSystem.hpp"
+
+#include <SFML/System/Time.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Keeps the particle work of a frame within a time budget by giving up quality instead of frames.
+// Every update() the measured cost of all registered effects (their systems' update and draw phases and their
+// emitters, from getStats()) is compared with the budget, and a global quality level between the minimum and 1
+// is lowered at once when over budget and raised slowly when there is room again, with a dead band in between,
+// so the level settles instead of oscillating. Rises in cost are followed almost at once, falls slowly.
+// Each effect gets level^(1 / priority) of that, so effects with a higher priority keep more of their quality.
+// An effect at quality q
+//  - emits at q times its base emission rate,
+//  - draws only min(1, 2q) of its particles,
+//  - runs its expensive affectors every second update below a quality of 1/4, every fourth below 1/8.
+// Phases that run on a ThreadPool report time summed over all threads, so the budget is in CPU time; pass a
+// wall-clock measurement to update(measured) instead to budget the frame itself (or with SMARTICLES_NO_STATS).
+// Call it from the thread that updates the systems.
+class QualityController
+{
+public:
+    explicit QualityController(sf::Time budget);
+public:
+    //returns an id for the other functions; expensiveAffectors are indices as passed to setAffectorInterval()
+    template <typename ParticleType, typename InheritFrom, typename Storage>
+    std::size_t add(ParticleSystem<ParticleType, Storage>& system, Emitter<ParticleType, InheritFrom, Storage>* emitter,
+                    float priority = 1.f, std::vector<std::size_t> expensiveAffectors = {});
+    template <typename ParticleType, typename Storage>
+    std::size_t add(ParticleSystem<ParticleType, Storage>& system, float priority = 1.f, std::vector<std::size_t> expensiveAffectors = {});
+    void clear();
+
+    void setBudget(sf::Time budget);
+    sf::Time getBudget() const;
+    //quality never goes below this, in (0, 1]
+    void setMinimumQuality(float quality);
+    //the emission rate at full quality; taken from the emitter in add(), set it here instead of on the emitter
+    void setBaseEmissionRate(std::size_t effect, float rate);
+
+    void update();
+    void update(sf::Time measured);
+
+    float getLevel() const;
+    float getQuality(std::size_t effect) const;
+    sf::Time getSmoothedCost() const;
+private:
+    struct Effect
+    {
+        float priority;
+        float baseRate;
+        float quality;
+        std::function<sf::Time()> cost;
+        std::function<void(float)> setEmissionRate;     //empty without an emitter
+        std::function<void(float)> setRenderFraction;
+        std::function<void(unsigned)> setAffectorInterval;
+    };
+private:
+    std::size_t push(Effect effect);
+    void apply(Effect& effect);
+private:
+    sf::Time mBudget;
+    float mMinimum = 0.05f;
+    float mLevel = 1.f;
+    float mSmoothed = 0.f;      //seconds
+    std::vector<Effect> mEffects;
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename InheritFrom, typename Storage>
+std::size_t QualityController::add(ParticleSystem<ParticleType, Storage>& system, Emitter<ParticleType, InheritFrom, Storage>* emitter,
+                                   float priority, std::vector<std::size_t> expensiveAffectors)
+{
+    Effect effect;
+    effect.priority = priority;
+    effect.baseRate = emitter ? emitter->getEmissionRate() : 0.f;
+    effect.quality = 1.f;
+    effect.cost = [&system, emitter]()
+    {
+        const ParticleStats& stats = system.getStats();
+        sf::Time cost = stats.aging + stats.spatialIndex + stats.affectors + stats.sort + stats.vertices + stats.finalizers + stats.draw;
+        if (emitter)
+            cost += emitter->getStats().emission;
+        return cost;
+    };
+    if (emitter)
+        effect.setEmissionRate = [emitter](float rate) { emitter->setEmissionRate(rate); };
+    effect.setRenderFraction = [&system](float fraction) { system.setRenderFraction(fraction); };
+    effect.setAffectorInterval = [&system, expensiveAffectors](unsigned interval)
+    {
+        for (std::size_t affector : expensiveAffectors)
+            system.setAffectorInterval(affector, interval);
+    };
+    return push(std::move(effect));
+}
+
+template <typename ParticleType, typename Storage>
+std::size_t QualityController::add(ParticleSystem<ParticleType, Storage>& system, float priority, std::vector<std::size_t> expensiveAffectors)
+{
+    return add<ParticleType, sf::Transformable, Storage>(system, nullptr, priority, std::move(expensiveAffectors));
+}
+
+#endif
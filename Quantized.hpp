@@ -0,0 +1,83 @@
+#ifndef QUANTIZED_HPP
+#define QUANTIZED_HPP
+
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Small fixed-point types for particles that don't need full precision, e.g. ambient effects,
+// so that several times more of them fit into a cache line. They convert to and from float implicitly,
+// so affectors keep working in float and never see the bits.
+namespace quant
+{
+    //a scalar in [0, 1] in 8 bits, steps of 1/255
+    struct Unorm8
+    {
+        std::uint8_t bits = 0;
+
+        Unorm8() = default;
+        Unorm8(float value) : bits(static_cast<std::uint8_t>(std::lround(std::min(1.f, std::max(0.f, value)) * 255.f))) {}
+        operator float() const { return bits / 255.f; }
+    };
+
+    //a scalar in [-1, 1] in 8 bits, steps of 1/127
+    struct Snorm8
+    {
+        std::int8_t bits = 0;
+
+        Snorm8() = default;
+        Snorm8(float value) : bits(static_cast<std::int8_t>(std::lround(std::min(1.f, std::max(-1.f, value)) * 127.f))) {}
+        operator float() const { return bits / 127.f; }
+    };
+
+    //a well mixed value in [0, 1) from two integers, for dithering
+    inline float dither(std::uint32_t a, std::uint32_t b)
+    {
+        std::uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        return static_cast<float>(h >> 8) * (1.f / 16777216.f);
+    }
+
+    // How storage::Compact packs the position and lifetime of a BaseParticle.
+    // Positions are 16 bit signed fixed point relative to origin, in steps of step pixels, so they reach
+    // 32767 steps either way (2048 pixels at the default 1/16); positions further out are clamped to the edge.
+    // Lifetimes are 16 bit counts of tick, so they reach 65535 ticks (65 seconds at the default millisecond).
+    struct Codec
+    {
+        sf::Vector2f origin = {0.f, 0.f};
+        float step = 1.f / 16.f;
+        sf::Time tick = sf::milliseconds(1);
+
+        //dither in [0, 1) picks where between two steps the value is rounded up; a random one makes rounding
+        //unbiased on average, so that movements smaller than a step still add up over many updates
+        std::int16_t encode(float coordinate, float originCoordinate, float dither = 0.5f) const
+        {
+            const float steps = std::floor((coordinate - originCoordinate) / step + dither);
+            return static_cast<std::int16_t>(std::min(32767.f, std::max(-32767.f, steps)));
+        }
+
+        float decode(std::int16_t coordinate, float originCoordinate) const
+        {
+            return originCoordinate + coordinate * step;
+        }
+
+        std::uint16_t encode(sf::Time lifetime) const
+        {
+            //rounded up, so a living particle never comes out dead
+            const sf::Int64 ticks = (lifetime.asMicroseconds() + tick.asMicroseconds() - 1) / tick.asMicroseconds();
+            return static_cast<std::uint16_t>(std::min<sf::Int64>(65535, std::max<sf::Int64>(0, ticks)));
+        }
+
+        sf::Time decode(std::uint16_t ticks) const
+        {
+            return tick * static_cast<sf::Int64>(ticks);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,375 @@
+#include "RadixSort.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    //radix passes work on bigger chunks than the particles, so that the digit counts of all chunks stay small
+    constexpr std::size_t kRadixChunk = 1 << 16;
+    constexpr std::size_t kDigits = 256;
+    //a chunk sorted on its own fits in cache, so it can take wider digits and fewer passes
+    constexpr unsigned kLocalBits = 11;
+    constexpr std::uint32_t kLocalDigits = 1u << kLocalBits;
+    //merging is tried with up to one descent, or one key out of reach of its chunk, per kMergeShare keys,
+    //and kept with up to one loose key per kLooseShare; chunks with more than one descent per kLocalShare
+    //keys are sorted on their own first
+    constexpr std::size_t kMergeShare = 16;
+    constexpr std::size_t kLooseShare = 8;
+    constexpr std::size_t kLocalShare = 16;
+
+    std::uint64_t pair(std::uint32_t key, std::size_t index)
+    {
+        return static_cast<std::uint64_t>(key) << 32 | static_cast<std::uint32_t>(index);
+    }
+
+    //LSD radix sort of a chunk of pairs on one thread, the result in data
+    void sortChunk(std::uint64_t* data, std::uint64_t* scratch, std::size_t count, std::uint32_t varying)
+    {
+        std::uint64_t* from = data;
+        std::uint64_t* to = scratch;
+        for (unsigned shift = 0; shift < 32; shift += kLocalBits)
+        {
+            if (((varying >> shift) & (kLocalDigits - 1)) == 0)
+                continue;
+            const unsigned bit = 32 + shift;
+            std::uint32_t cursors[kLocalDigits] = {};
+            for (std::size_t i = 0; i < count; ++i)
+                ++cursors[(from[i] >> bit) & (kLocalDigits - 1)];
+            std::uint32_t total = 0;
+            for (std::uint32_t& cursor : cursors)
+            {
+                const std::uint32_t n = cursor;
+                cursor = total;
+                total += n;
+            }
+            for (std::size_t i = 0; i < count; ++i)
+                to[cursors[(from[i] >> bit) & (kLocalDigits - 1)]++] = from[i];
+            std::swap(from, to);
+        }
+        if (from != data)
+            std::copy(from, from + count, data);
+    }
+}
+
+bool RadixSort::sort(const std::uint32_t* keys, std::size_t count, ThreadPool* pool, std::size_t chunkSize)
+{
+    mLastPass = Pass::Sorted;
+    if (count < 2)
+        return false;
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+
+    //how far from sorted, and which bits differ between keys
+    mChunks.resize((count + chunkSize - 1) / chunkSize);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        Chunk& chunk = mChunks[begin / chunkSize];
+        std::size_t descents = 0;
+        std::uint32_t all = ~0u, any = 0, low = ~0u, high = 0;
+        std::uint32_t previous = begin ? keys[begin - 1] : 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const std::uint32_t key = keys[i];
+            descents += key < previous;
+            all &= key;
+            any |= key;
+            low = std::min(low, key);
+            high = std::max(high, key);
+            previous = key;
+        }
+        chunk.descents = descents;
+        chunk.all = all;
+        chunk.any = any;
+        chunk.low = low;
+        chunk.high = high;
+    });
+    std::size_t descents = 0;
+    std::uint32_t all = ~0u, any = 0;
+    for (Chunk const& chunk : mChunks)
+    {
+        descents += chunk.descents;
+        all &= chunk.all;
+        any |= chunk.any;
+    }
+    if (descents == 0)
+        return false;
+    mOrder.resize(count);
+
+    //many descents are cheap as long as keys stay within reach of their chunk, i.e. sorting every chunk on
+    //its own would leave few keys out of place
+    bool near = descents <= count / kMergeShare;
+    if (!near)
+    {
+        std::uint32_t floor = 0;
+        for (Chunk& chunk : mChunks)
+        {
+            chunk.floor = floor;
+            floor = std::max(floor, chunk.high);
+        }
+        std::uint32_t ceiling = ~0u;
+        for (std::size_t c = mChunks.size(); c-- > 0;)
+        {
+            mChunks[c].ceiling = ceiling;
+            ceiling = std::min(ceiling, mChunks[c].low);
+        }
+        ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+        {
+            Chunk& chunk = mChunks[begin / chunkSize];
+            std::size_t far = 0;
+            for (std::size_t i = begin; i < end; ++i)
+                far += keys[i] < chunk.floor || keys[i] > chunk.ceiling;
+            chunk.loose = far;
+        });
+        std::size_t far = 0;
+        for (Chunk const& chunk : mChunks)
+            far += chunk.loose;
+        near = far <= count / kMergeShare;
+    }
+    if (near && merge(keys, count, pool, chunkSize))
+    {
+        mLastPass = Pass::Merge;
+        findMoved(count, pool, chunkSize);
+        return true;
+    }
+
+    mPairs.resize(count);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            mPairs[i] = pair(keys[i], i);
+    });
+    radix(mPairs, count, all ^ any, pool);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            mOrder[i] = static_cast<std::uint32_t>(mPairs[i]);
+    });
+    mLastPass = Pass::Radix;
+    findMoved(count, pool, chunkSize);
+    return true;
+}
+
+//splits the keys into an ascending run (kept) and the rest (loose), sorts the loose keys and merges them back in;
+//gives up, before touching mOrder, if too many keys are loose
+bool RadixSort::merge(const std::uint32_t* keys, std::size_t count, ThreadPool* pool, std::size_t chunkSize)
+{
+    //every chunk keeps a key if it is bigger than the last one kept and smaller than the next one, so a single key
+    //out of place doesn't make everything after it loose. Kept pairs are compacted in place, loose ones go to mScratch.
+    mPairs.resize(count);
+    mScratch.resize(std::max(mScratch.size(), count));
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        Chunk& chunk = mChunks[begin / chunkSize];
+        std::uint64_t* pairs = mPairs.data() + begin;
+        std::uint64_t* loose = mScratch.data() + begin;
+        const std::size_t size = end - begin;
+        for (std::size_t i = 0; i < size; ++i)
+            pairs[i] = pair(keys[begin + i], begin + i);
+        chunk.local = chunk.descents * kLocalShare > size;
+        if (chunk.local)
+            sortChunk(pairs, loose, size, chunk.all ^ chunk.any);
+
+        std::size_t kept = 0, other = 0;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            const std::uint64_t value = pairs[i];
+            if ((kept == 0 || value > pairs[kept - 1]) && (i + 1 == size || value < pairs[i + 1]))
+                pairs[kept++] = value;
+            else
+                loose[other++] = value;
+        }
+        chunk.kept = kept;
+        chunk.loose = other;
+        chunk.dropped = 0;
+        chunk.trimmed = 0;
+    });
+
+    //the runs of all chunks have to add up to one. Where a run ends above the start of the next one, either the end
+    //of the one (trimmed) or the start of the other (dropped) becomes loose too, whichever holds fewer pairs; that way
+    //a single pair out of place at either end doesn't hold back everything after it.
+    Chunk* previous = nullptr;
+    const std::uint64_t* before = nullptr;
+    for (std::size_t c = 0; c < mChunks.size(); ++c)
+    {
+        Chunk& chunk = mChunks[c];
+        const std::uint64_t* run = mPairs.data() + c * chunkSize;
+        if (previous && chunk.kept && before[previous->kept - 1] > run[0])
+        {
+            const std::uint64_t last = before[previous->kept - 1];
+            const std::size_t trim = before + previous->kept - std::upper_bound(before + previous->dropped, before + previous->kept, run[0]);
+            const std::size_t drop = std::lower_bound(run, run + chunk.kept, last) - run;
+            if (trim < previous->kept - previous->dropped && trim <= drop)
+            {
+                previous->kept -= trim;
+                previous->trimmed += trim;
+            }
+            else
+                chunk.dropped = drop;
+        }
+        if (chunk.dropped < chunk.kept)
+        {
+            previous = &chunk;
+            before = run;
+        }
+    }
+    std::size_t loose = 0;
+    for (Chunk const& chunk : mChunks)
+        loose += chunk.loose + chunk.dropped + chunk.trimmed;
+    if (loose > count / kLooseShare)
+        return false;
+
+    //the loose pairs, with equal keys by index so that the radix sort keeps ties in order: a chunk sorted on its own
+    //has all three lists (dropped, trimmed, loose) in pair order, any other chunk has them in index order
+    mLoose.resize(std::max(mLoose.size(), loose));
+    std::size_t n = 0;
+    std::uint32_t all = ~0u, any = 0;
+    for (std::size_t c = 0; c < mChunks.size(); ++c)
+    {
+        Chunk const& chunk = mChunks[c];
+        const std::uint64_t* pairs = mPairs.data() + c * chunkSize;
+        const std::uint64_t* other = mScratch.data() + c * chunkSize;
+        const std::uint64_t* otherEnd = other + chunk.loose;
+        const std::uint64_t mask = chunk.local ? ~std::uint64_t(0) : 0xFFFFFFFFu;
+        //the dropped pairs, then the trimmed ones
+        std::size_t next = 0;
+        const std::size_t removed = chunk.dropped + chunk.trimmed;
+        auto at = [&chunk, pairs](std::size_t i) { return i < chunk.dropped ? pairs[i] : pairs[chunk.kept + i - chunk.dropped]; };
+        while (next != removed || other != otherEnd)
+        {
+            const bool first = other == otherEnd || (next != removed && (at(next) & mask) < (*other & mask));
+            const std::uint64_t value = first ? at(next++) : *other++;
+            mLoose[n++] = value;
+            all &= static_cast<std::uint32_t>(value >> 32);
+            any |= static_cast<std::uint32_t>(value >> 32);
+        }
+    }
+    radix(mLoose, loose, all ^ any, pool);
+
+    //every chunk merges its kept pairs with the loose pairs that sort between its first kept pair and the next chunk's
+    std::size_t output = 0;
+    previous = nullptr;
+    for (std::size_t c = 0; c < mChunks.size(); ++c)
+    {
+        Chunk& chunk = mChunks[c];
+        chunk.firstLoose = chunk.lastLoose = 0;
+        if (chunk.dropped == chunk.kept)
+            continue;
+        const std::uint64_t first = mPairs[c * chunkSize + chunk.dropped];
+        const std::size_t split = previous ? std::lower_bound(mLoose.begin(), mLoose.begin() + loose, first) - mLoose.begin() : 0;
+        if (previous)
+            previous->lastLoose = split;
+        chunk.firstLoose = split;
+        chunk.output = output + split;
+        output += chunk.kept - chunk.dropped;
+        previous = &chunk;
+    }
+    if (previous)
+        previous->lastLoose = loose;
+
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t)
+    {
+        Chunk const& chunk = mChunks[begin / chunkSize];
+        if (chunk.dropped == chunk.kept)
+            return;
+        const std::uint64_t* own = mPairs.data() + begin + chunk.dropped;
+        const std::uint64_t* ownEnd = mPairs.data() + begin + chunk.kept;
+        const std::uint64_t* other = mLoose.data() + chunk.firstLoose;
+        const std::uint64_t* otherEnd = mLoose.data() + chunk.lastLoose;
+        std::uint32_t* out = mOrder.data() + chunk.output;
+        while (own != ownEnd && other != otherEnd)
+            *out++ = static_cast<std::uint32_t>(*other < *own ? *other++ : *own++);
+        while (own != ownEnd)
+            *out++ = static_cast<std::uint32_t>(*own++);
+        while (other != otherEnd)
+            *out++ = static_cast<std::uint32_t>(*other++);
+    });
+    return true;
+}
+
+//sorts pairs[0, count) by their keys, through mScratch; varying has the bits that differ between keys,
+//digits without any are skipped
+void RadixSort::radix(std::vector<std::uint64_t>& pairs, std::size_t count, std::uint32_t varying, ThreadPool* pool)
+{
+    const std::size_t chunks = (count + kRadixChunk - 1) / kRadixChunk;
+    mScratch.resize(std::max(mScratch.size(), count));
+    mCounts.resize(chunks * kDigits);
+    for (unsigned shift = 0; shift < 32; shift += 8)
+    {
+        if (((varying >> shift) & (kDigits - 1)) == 0)
+            continue;
+        const unsigned bit = 32 + shift;
+        ThreadPool::run(pool, count, kRadixChunk, [&](std::size_t begin, std::size_t end)
+        {
+            std::uint32_t* counts = mCounts.data() + begin / kRadixChunk * kDigits;
+            std::fill(counts, counts + kDigits, 0u);
+            for (std::size_t i = begin; i < end; ++i)
+                ++counts[(pairs[i] >> bit) & (kDigits - 1)];
+        });
+        //digit by digit, chunk by chunk within a digit, which keeps the sort stable
+        std::uint32_t total = 0;
+        for (std::size_t d = 0; d < kDigits; ++d)
+            for (std::size_t c = 0; c < chunks; ++c)
+            {
+                const std::uint32_t n = mCounts[c * kDigits + d];
+                mCounts[c * kDigits + d] = total;
+                total += n;
+            }
+        ThreadPool::run(pool, count, kRadixChunk, [&](std::size_t begin, std::size_t end)
+        {
+            std::uint32_t* cursors = mCounts.data() + begin / kRadixChunk * kDigits;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const std::uint64_t value = pairs[i];
+                mScratch[cursors[(value >> bit) & (kDigits - 1)]++] = value;
+            }
+        });
+        std::swap(pairs, mScratch);
+    }
+}
+
+//compacts the slots of mOrder that changed into mMoved, chunk by chunk
+void RadixSort::findMoved(std::size_t count, ThreadPool* pool, std::size_t chunkSize)
+{
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        std::size_t moved = 0;
+        for (std::size_t k = begin; k < end; ++k)
+            moved += mOrder[k] != k;
+        mChunks[begin / chunkSize].moved = moved;
+    });
+    std::size_t total = 0;
+    for (Chunk& chunk : mChunks)
+    {
+        const std::size_t moved = chunk.moved;
+        chunk.moved = total;
+        total += moved;
+    }
+    mMoved.resize(total);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        std::uint32_t* out = mMoved.data() + mChunks[begin / chunkSize].moved;
+        for (std::size_t k = begin; k < end; ++k)
+            if (mOrder[k] != k)
+                *out++ = static_cast<std::uint32_t>(k);
+    });
+}
+
+const std::vector<std::uint32_t>& RadixSort::getOrder() const
+{
+    return mOrder;
+}
+
+const std::vector<std::uint32_t>& RadixSort::getMoved() const
+{
+    return mMoved;
+}
+
+RadixSort::Pass RadixSort::getLastPass() const
+{
+    return mLastPass;
+}
+
+std::size_t RadixSort::bytes() const
+{
+    return (mOrder.capacity() + mMoved.capacity() + mCounts.capacity()) * sizeof(std::uint32_t) + mChunks.capacity() * sizeof(Chunk)
+         + (mPairs.capacity() + mScratch.capacity() + mLoose.capacity()) * sizeof(std::uint64_t);
+}
@@ -0,0 +1,100 @@
+#ifndef RADIXSORT_HPP
+#define RADIXSORT_HPP
+
+#include "ThreadPool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Stable sort of 32 bit keys into a permutation, what ParticleSystem orders its particles by.
+// sort() first checks how far the keys are from sorted, so that keys which barely changed since they
+// were last sorted stay cheap:
+// * already sorted keys cost one pass over them and need nothing moved;
+// * when keys only moved a little (few of them, or all of them but not far), every chunk of keys that is far
+//   from sorted is sorted on its own, then the keys still out of place (mostly around chunk boundaries)
+//   are pulled out, sorted apart and merged back in between the others, chunk by chunk;
+// * anything else gets a full LSD radix sort, 8 bits per pass, that skips the passes of digits every
+//   key has in common.
+// With a pool every pass over all keys runs chunk by chunk on it. The result never depends on the pool.
+class RadixSort
+{
+public:
+    enum class Pass
+    {
+        Sorted,
+        Merge,
+        Radix
+    };
+public:
+    //the order that sorts keys[0, count) ascending, ties by index; returns false, and leaves getOrder()
+    //as it was, if the keys already were in order
+    bool sort(const std::uint32_t* keys, std::size_t count, ThreadPool* pool = nullptr, std::size_t chunkSize = 4096);
+    //getOrder()[k] is the index of the k-th smallest key
+    const std::vector<std::uint32_t>& getOrder() const;
+    //the slots k whose getOrder()[k] isn't k, ascending
+    const std::vector<std::uint32_t>& getMoved() const;
+    //how the last sort() got there
+    Pass getLastPass() const;
+    std::size_t bytes() const;
+private:
+    struct Chunk
+    {
+        std::size_t descents;   //keys smaller than the one before them
+        std::uint32_t all;      //bits set in every key
+        std::uint32_t any;      //bits set in some key
+        std::uint32_t low;
+        std::uint32_t high;
+        std::uint32_t floor;    //the highest key of all chunks before
+        std::uint32_t ceiling;  //the lowest key of all chunks after
+        bool local;             //sorted on its own before merging
+        std::size_t kept;       //keys in order, at mPairs[begin, begin + kept)
+        std::size_t loose;      //the others, at mScratch[begin, begin + loose)
+        std::size_t trimmed;    //kept keys at its end bigger than some key of the next chunk, right after the kept ones
+        std::size_t dropped;    //kept keys that turned out smaller than a previous chunk's
+        std::size_t output;     //where the chunk's first kept key goes
+        std::size_t firstLoose; //the sorted loose keys merged in after it
+        std::size_t lastLoose;
+        std::size_t moved;      //slots whose index changed, then the first of them in mMoved
+    };
+private:
+    bool merge(const std::uint32_t* keys, std::size_t count, ThreadPool* pool, std::size_t chunkSize);
+    void radix(std::vector<std::uint64_t>& pairs, std::size_t count, std::uint32_t varying, ThreadPool* pool);
+    void findMoved(std::size_t count, ThreadPool* pool, std::size_t chunkSize);
+private:
+    std::vector<std::uint32_t> mOrder;
+    std::vector<std::uint32_t> mMoved;
+    std::vector<Chunk> mChunks;
+    std::vector<std::uint64_t> mPairs;      //key << 32 | index, so that pairs compare like keys with ties by index
+    std::vector<std::uint64_t> mScratch;
+    std::vector<std::uint64_t> mLoose;
+    std::vector<std::uint32_t> mCounts;     //digit counts of every radix chunk
+    Pass mLastPass = Pass::Sorted;
+};
+
+namespace radix
+{
+    //maps a key of any arithmetic type to 32 bits that sort the same way: floats by their bits with the sign
+    //flipped (and every negative number's other bits too), signed integers with the sign bit flipped.
+    //doubles are rounded to float, and wider integers keep their low 32 bits.
+    template <typename T>
+    std::uint32_t key(T value)
+    {
+        static_assert(std::is_arithmetic_v<T>, "sort keys have to be numbers");
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            const float single = static_cast<float>(value) + 0.f;   //-0 sorts like 0
+            std::uint32_t bits;
+            std::memcpy(&bits, &single, sizeof(bits));
+            return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+        }
+        else if constexpr (std::is_signed_v<T>)
+            return static_cast<std::uint32_t>(value) ^ 0x80000000u;
+        else
+            return static_cast<std::uint32_t>(value);
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "Random.hpp"
+
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+    std::uint64_t makeSeed()
+    {
+        std::random_device device;
+        return (static_cast<std::uint64_t>(device()) << 32) ^ device();
+    }
+
+    std::atomic<std::uint64_t> globalSeed(makeSeed());
+    std::atomic<std::uint64_t> nextStream(0);
+    //bumped by every seed(), so thread generators know to start over
+    std::atomic<std::uint64_t> generation(0);
+}
+
+void Rng::fill(float* out, std::size_t count, float a, float b)
+{
+    const float scale = (b - a) * (1.f / 16777216.f);
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] = a + static_cast<float>((*this)() >> 8) * scale;
+}
+
+void Rng::fillDisc(sf::Vector2f* out, std::size_t count, sf::Vector2f center, float radius)
+{
+    fillBand(out, count, center, 0.f, radius);
+}
+
+void Rng::fillBand(sf::Vector2f* out, std::size_t count, sf::Vector2f center, float innerRadius, float outerRadius)
+{
+    //uniform in r^2 keeps the density even over the area instead of piling points up in the middle
+    const float inner2 = innerRadius * innerRadius;
+    const float outer2 = outerRadius * outerRadius;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float r = std::sqrt(uniform(inner2, outer2));
+        const float angle = uniform(0.f, 6.28318530718f);
+        out[i] = {center.x + r * std::cos(angle), center.y + r * std::sin(angle)};
+    }
+}
+
+Rng Rng::split()
+{
+    const std::uint64_t seed = (static_cast<std::uint64_t>((*this)()) << 32) | (*this)();
+    const std::uint64_t stream = (static_cast<std::uint64_t>((*this)()) << 32) | (*this)();
+    return Rng(seed, stream);
+}
+
+namespace rng
+{
+    void seed(std::uint64_t seed)
+    {
+        globalSeed.store(seed);
+        nextStream.store(0);
+        generation.fetch_add(1);
+    }
+
+    std::uint64_t getSeed()
+    {
+        return globalSeed.load();
+    }
+
+    Rng make()
+    {
+        return Rng(globalSeed.load(), nextStream.fetch_add(1));
+    }
+
+    Rng& local()
+    {
+        thread_local Rng generator;
+        thread_local std::uint64_t seen = ~std::uint64_t(0);
+        const std::uint64_t current = generation.load(std::memory_order_relaxed);
+        if (seen != current)
+        {
+            generator = make();
+            seen = current;
+        }
+        return generator;
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+
+// Small, fast random number generator (PCG32, XSH-RR output) with independent streams.
+// Two generators with the same seed but different streams never produce overlapping sequences,
+// so every thread and every Emitter gets its own stream instead of sharing one engine.
+// Rng is a UniformRandomBitGenerator, so it also works with the <random> distributions.
+class Rng
+{
+public:
+    using result_type = std::uint32_t;
+public:
+    explicit Rng(std::uint64_t seed = 0x853c49e6748fea9bULL, std::uint64_t stream = 0);
+public:
+    void seed(std::uint64_t seed, std::uint64_t stream = 0);
+
+    result_type operator()();
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    //[0, 1)
+    float uniform();
+    //[a, b)
+    float uniform(float a, float b);
+    //[a, b], without the bias of a plain modulo
+    std::uint32_t uniform(std::uint32_t a, std::uint32_t b);
+    //same as getRandom(a, b): inclusive for integers, [a, b) for floating point
+    template <typename Numeric>
+    Numeric range(Numeric a, Numeric b);
+
+    //count uniform floats in [a, b)
+    void fill(float* out, std::size_t count, float a, float b);
+    //count points spread evenly over the area of a disc
+    void fillDisc(sf::Vector2f* out, std::size_t count, sf::Vector2f center, float radius);
+    //count points spread evenly over the area of the ring between the two radii
+    void fillBand(sf::Vector2f* out, std::size_t count, sf::Vector2f center, float innerRadius, float outerRadius);
+
+    //a generator on a stream of its own, seeded from this one
+    Rng split();
+private:
+    std::uint64_t mState;
+    std::uint64_t mIncrement;
+};
+
+namespace rng
+{
+    //reseeds the whole subsystem: thread generators and every generator handed out by make() afterwards.
+    //Without a call to seed() the seed comes from std::random_device, so runs differ.
+    void seed(std::uint64_t seed);
+    std::uint64_t getSeed();
+
+    //a generator on the next free stream of the current seed; streams are numbered in the order of the calls
+    Rng make();
+
+    //this thread's generator, created on first use and recreated after seed()
+    Rng& local();
+}
+
+// INLINE DEFINITIONS
+
+inline Rng::Rng(std::uint64_t seed, std::uint64_t stream)
+: mState(0)
+, mIncrement(0)
+{
+    this->seed(seed, stream);
+}
+
+inline void Rng::seed(std::uint64_t seed, std::uint64_t stream)
+{
+    mState = 0;
+    mIncrement = (stream << 1u) | 1u;
+    (*this)();
+    mState += seed;
+    (*this)();
+}
+
+inline Rng::result_type Rng::operator()()
+{
+    const std::uint64_t old = mState;
+    mState = old * 6364136223846793005ULL + mIncrement;
+    const std::uint32_t xorshifted = static_cast<std::uint32_t>(((old >> 18u) ^ old) >> 27u);
+    const std::uint32_t rot = static_cast<std::uint32_t>(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+}
+
+inline float Rng::uniform()
+{
+    //the top 24 bits fill a float's mantissa exactly
+    return static_cast<float>((*this)() >> 8) * (1.f / 16777216.f);
+}
+
+inline float Rng::uniform(float a, float b)
+{
+    return a + (b - a) * uniform();
+}
+
+inline std::uint32_t Rng::uniform(std::uint32_t a, std::uint32_t b)
+{
+    //Lemire's multiply-and-reject
+    const std::uint64_t span = static_cast<std::uint64_t>(b - a) + 1;
+    if (span > max())
+        return (*this)();
+    std::uint64_t product = static_cast<std::uint64_t>((*this)()) * span;
+    std::uint32_t low = static_cast<std::uint32_t>(product);
+    if (low < span)
+    {
+        const std::uint32_t threshold = static_cast<std::uint32_t>((0x100000000ULL - span) % span);
+        while (low < threshold)
+        {
+            product = static_cast<std::uint64_t>((*this)()) * span;
+            low = static_cast<std::uint32_t>(product);
+        }
+    }
+    return a + static_cast<std::uint32_t>(product >> 32);
+}
+
+template <typename Numeric>
+Numeric Rng::range(Numeric a, Numeric b)
+{
+    if constexpr (std::is_same_v<Numeric, float>)
+    {
+        return uniform(a, b);
+    }
+    else if constexpr (std::is_floating_point_v<Numeric>)
+    {
+        //53 random bits for double precision
+        const std::uint64_t bits = (static_cast<std::uint64_t>((*this)()) << 21) ^ ((*this)() >> 11);
+        return a + (b - a) * static_cast<Numeric>(bits * (1.0 / 9007199254740992.0));
+    }
+    else if constexpr (std::is_integral_v<Numeric> && sizeof(Numeric) <= sizeof(std::uint32_t))
+    {
+        const std::uint32_t span = static_cast<std::uint32_t>(static_cast<std::int64_t>(b) - static_cast<std::int64_t>(a));
+        return static_cast<Numeric>(static_cast<std::int64_t>(a) + uniform(std::uint32_t(0), span));
+    }
+    else
+    {
+        return std::uniform_int_distribution<Numeric>(a, b)(*this);
+    }
+}
+
+#endif
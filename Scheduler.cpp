@@ -0,0 +1,220 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    bool overlaps(const void* aSystem, const void* aKey, const void* bSystem, const void* bKey)
+    {
+        if (aSystem == bSystem)
+            return !aKey || !bKey || aKey == bKey;
+        //a system's address as shared state stands for all of that system
+        return (!aSystem && aKey == bSystem) || (!bSystem && bKey == aSystem);
+    }
+}
+
+Scheduler::Scheduler(ThreadPool* pool)
+: mThreadPool(pool)
+{
+
+}
+
+void Scheduler::clear()
+{
+    mEntries.clear();
+    mNodes.clear();
+    mStages.clear();
+    mCriticalPath.clear();
+}
+
+void Scheduler::setThreadPool(ThreadPool* pool)
+{
+    mThreadPool = pool;
+}
+
+void Scheduler::setVerticesEnabled(bool enabled)
+{
+    mVertices = enabled;
+}
+
+void Scheduler::update(sf::Time dt)
+{
+    const std::int64_t start = stats::now();
+    mNodes.clear();
+    mStages.clear();
+    for (std::size_t i = 0; i < mEntries.size(); ++i)
+    {
+        Entry& entry = mEntries[i];
+        if (entry.emit)
+            push({i, Kind::Emit, 0, sf::Time::Zero}, entry.system, [&entry, dt]() { entry.emit(dt); });
+        entry.stages(*this, i, dt);
+    }
+    link();
+
+    //the stages in the order they were pushed are one order that keeps every dependency
+    if (!mThreadPool)
+    {
+        for (std::size_t node = 0; node < mNodes.size(); ++node)
+        {
+            const std::int64_t begin = stats::now();
+            mNodes[node].run();
+            mStages[node].time = stats::toTime(stats::now() - begin);
+        }
+    }
+    else
+    {
+        std::vector<std::size_t> roots;
+        for (std::size_t node = 0; node < mNodes.size(); ++node)
+            if (mPending[node].load(std::memory_order_relaxed) == 0)
+                roots.push_back(node);
+        mThreadPool->parallelFor(roots.size(), 1, [this, &roots](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+                runFrom(roots[i]);
+        });
+    }
+
+    findCriticalPath();
+    mElapsed = stats::toTime(stats::now() - start);
+}
+
+const std::vector<Scheduler::Stage>& Scheduler::getStages() const
+{
+    return mStages;
+}
+
+const std::vector<std::size_t>& Scheduler::getCriticalPath() const
+{
+    return mCriticalPath;
+}
+
+sf::Time Scheduler::getCriticalPathTime() const
+{
+    return mCriticalPathTime;
+}
+
+sf::Time Scheduler::getWork() const
+{
+    return mWork;
+}
+
+sf::Time Scheduler::getElapsed() const
+{
+    return mElapsed;
+}
+
+//a stage that touches all of its system, until pushStages() says otherwise
+void Scheduler::push(Stage stage, const void* system, std::function<void()> run)
+{
+    Node node;
+    node.run = std::move(run);
+    node.system = system;
+    node.everything = true;
+    node.writes.push_back({system, nullptr});
+    mNodes.push_back(std::move(node));
+    mStages.push_back(stage);
+}
+
+void Scheduler::scope(std::vector<sched::Resource> const& resources, const void* system, bool packed, std::vector<Key>& keys)
+{
+    for (sched::Resource const& resource : resources)
+    {
+        if (resource.attribute)
+            keys.push_back({system, packed ? nullptr : resource.key});
+        else
+            keys.push_back({nullptr, resource.key});
+    }
+}
+
+//an edge from every stage to every later one it conflicts with
+void Scheduler::link()
+{
+    auto any = [](std::vector<Key> const& a, std::vector<Key> const& b)
+    {
+        for (Key const& x : a)
+            for (Key const& y : b)
+                if (overlaps(x.system, x.key, y.system, y.key))
+                    return true;
+        return false;
+    };
+    while (mPending.size() < mNodes.size())
+        mPending.emplace_back(0);
+    for (std::size_t j = 0; j < mNodes.size(); ++j)
+    {
+        Node& later = mNodes[j];
+        std::size_t pending = 0;
+        for (std::size_t i = 0; i < j; ++i)
+        {
+            Node& earlier = mNodes[i];
+            const bool conflict = (earlier.system == later.system && (earlier.everything || later.everything))
+                               || any(earlier.writes, later.writes) || any(earlier.writes, later.reads) || any(later.writes, earlier.reads);
+            if (conflict)
+            {
+                earlier.next.push_back(j);
+                ++pending;
+            }
+        }
+        mPending[j].store(pending, std::memory_order_relaxed);
+    }
+}
+
+//runs a stage, then whatever it was the last dependency of: one of them on this thread, the rest spread over the pool
+void Scheduler::runFrom(std::size_t node)
+{
+    std::vector<std::size_t> ready;
+    while (true)
+    {
+        const std::int64_t start = stats::now();
+        mNodes[node].run();
+        mStages[node].time = stats::toTime(stats::now() - start);
+
+        ready.clear();
+        for (std::size_t next : mNodes[node].next)
+            if (mPending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                ready.push_back(next);
+        if (ready.empty())
+            return;
+        if (ready.size() == 1)
+        {
+            node = ready.front();
+            continue;
+        }
+        mThreadPool->parallelFor(ready.size(), 1, [this, &ready](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+                runFrom(ready[i]);
+        });
+        return;
+    }
+}
+
+//the longest chain of stages by their times; edges only go forward, so one pass in order finds it
+void Scheduler::findCriticalPath()
+{
+    const std::size_t none = mNodes.size();
+    std::vector<sf::Time> finish(mNodes.size(), sf::Time::Zero);
+    std::vector<std::size_t> from(mNodes.size(), none);
+    std::size_t last = none;
+    mWork = sf::Time::Zero;
+    for (std::size_t i = 0; i < mNodes.size(); ++i)
+    {
+        finish[i] += mStages[i].time;
+        mWork += mStages[i].time;
+        for (std::size_t next : mNodes[i].next)
+        {
+            if (from[next] == none || finish[i] > finish[next])
+            {
+                finish[next] = finish[i];
+                from[next] = i;
+            }
+        }
+        if (last == none || finish[i] > finish[last])
+            last = i;
+    }
+
+    mCriticalPath.clear();
+    mCriticalPathTime = last == none ? sf::Time::Zero : finish[last];
+    for (std::size_t i = last; i != none; i = from[i])
+        mCriticalPath.push_back(i);
+    std::reverse(mCriticalPath.begin(), mCriticalPath.end());
+}
@@ -0,0 +1,169 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "Access.hpp"
+#include "Emitter.hpp"
+#include "ParticleSystem.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+
+#include <SFML/System/Time.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+// Updates any number of ParticleSystems at once, overlapping whatever doesn't depend on each other.
+// Every update() cuts each system's frame into stages (its emitter, removing and aging, every affector that is
+// due, sorting, and building the quads with the finalizers) and builds a graph of them: a stage runs after every
+// earlier stage it conflicts with, as told by the sched::Access of affectors and finalizers. Stages without a
+// conflict run at the same time on the pool, a stage starting as soon as all stages before it are done, so two
+// affectors of disjoint attributes overlap, and so do independent systems. Stages that conflict keep the order in
+// which systems were added and affectors were added to them, so results are those of updating one system after
+// another, as long as the declarations hold.
+// After each update() the stages carry how long they took, and the critical path, the chain of dependent stages
+// that took longest, says what bounded the update however many threads there are.
+class Scheduler
+{
+public:
+    enum class Kind
+    {
+        Emit,
+        Begin,      //removing dead particles, the spatial index and aging
+        Affector,
+        End,        //sorting, stats and events
+        Vertices    //the quads and the finalizers
+    };
+    struct Stage
+    {
+        std::size_t system;     //by the order they were added
+        Kind kind;
+        std::size_t index;      //the affector, for Kind::Affector
+        sf::Time time;          //wall-clock, in the last update()
+    };
+public:
+    explicit Scheduler(ThreadPool* pool = nullptr);
+public:
+    //returns the system's index in Stage::system
+    template <typename ParticleType, typename Storage>
+    std::size_t add(ParticleSystem<ParticleType, Storage>& system);
+    //emitter updates the system, before the system's own stages
+    template <typename ParticleType, typename InheritFrom, typename Storage>
+    std::size_t add(ParticleSystem<ParticleType, Storage>& system, Emitter<ParticleType, InheritFrom, Storage>& emitter);
+    void clear();
+
+    void setThreadPool(ThreadPool* pool);
+    //whether the quads are built as the last stage of every system (the default), rather than by the next draw()
+    void setVerticesEnabled(bool enabled);
+
+    void update(sf::Time dt);
+
+    const std::vector<Stage>& getStages() const;
+    //indices into getStages() of the stages on the critical path of the last update(), first to last
+    const std::vector<std::size_t>& getCriticalPath() const;
+    sf::Time getCriticalPathTime() const;
+    //all stages together, for comparison with getElapsed()
+    sf::Time getWork() const;
+    sf::Time getElapsed() const;
+private:
+    //something a stage reads or writes: an attribute of a system (all of it with a null key), or shared state
+    struct Key
+    {
+        const void* system;     //null for shared state
+        const void* key;
+    };
+    struct Node
+    {
+        std::function<void()> run;
+        const void* system;
+        bool everything;        //all of its system, which orders it against every stage of the system
+        std::vector<Key> reads;
+        std::vector<Key> writes;
+        std::vector<std::size_t> next;
+    };
+    struct Entry
+    {
+        const void* system;
+        std::function<void(sf::Time)> emit;                                 //empty without an emitter
+        std::function<void(Scheduler&, std::size_t, sf::Time)> stages;      //pushes the system's stages of a frame
+    };
+private:
+    template <typename ParticleType, typename Storage>
+    void pushStages(ParticleSystem<ParticleType, Storage>& system, std::size_t index, sf::Time dt);
+    void push(Stage stage, const void* system, std::function<void()> run);
+    void scope(std::vector<sched::Resource> const& resources, const void* system, bool packed, std::vector<Key>& keys);
+    void link();
+    void runFrom(std::size_t node);
+    void findCriticalPath();
+private:
+    ThreadPool* mThreadPool;
+    bool mVertices = true;
+    std::vector<Entry> mEntries;
+    std::vector<Node> mNodes;
+    std::vector<Stage> mStages;                     //one per node
+    std::deque<std::atomic<std::size_t>> mPending;  //stages each node still waits for, a deque because atomics can't be moved
+    std::vector<std::size_t> mCriticalPath;
+    sf::Time mCriticalPathTime;
+    sf::Time mWork;
+    sf::Time mElapsed;
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename Storage>
+std::size_t Scheduler::add(ParticleSystem<ParticleType, Storage>& system)
+{
+    Entry entry;
+    entry.system = &system;
+    entry.stages = [&system](Scheduler& scheduler, std::size_t index, sf::Time dt) { scheduler.pushStages(system, index, dt); };
+    mEntries.push_back(std::move(entry));
+    return mEntries.size() - 1;
+}
+
+template <typename ParticleType, typename InheritFrom, typename Storage>
+std::size_t Scheduler::add(ParticleSystem<ParticleType, Storage>& system, Emitter<ParticleType, InheritFrom, Storage>& emitter)
+{
+    const std::size_t index = add(system);
+    mEntries[index].emit = [&emitter](sf::Time dt) { emitter.update(dt); };
+    return index;
+}
+
+template <typename ParticleType, typename Storage>
+void Scheduler::pushStages(ParticleSystem<ParticleType, Storage>& system, std::size_t index, sf::Time dt)
+{
+    //storage::Compact packs all attributes of a particle together, so they can only be written all at once
+    constexpr bool packed = std::is_same_v<Storage, storage::Compact>;
+    push({index, Kind::Begin, 0, sf::Time::Zero}, &system, [&system, dt]() { system.beginUpdate(dt); system.age(dt); });
+    for (std::size_t i = 0; i < system.mAffector.size(); ++i)
+    {
+        //beginUpdate() makes the affectors due that have no updates left to wait; the others are left out
+        if (system.mAffector[i].wait != 0)
+            continue;
+        push({index, Kind::Affector, i, sf::Time::Zero}, &system, [&system, i]() { system.runAffector(i); });
+        if (system.mAffector[i].access)
+        {
+            Node& node = mNodes.back();
+            node.everything = false;
+            node.writes.clear();
+            scope(system.mAffector[i].access->reads, &system, packed, node.reads);
+            scope(system.mAffector[i].access->writes, &system, packed, node.writes);
+        }
+    }
+    //the end hands out the system's events, so it touches whatever the listeners do
+    push({index, Kind::End, 0, sf::Time::Zero}, &system, [&system]() { system.endUpdate(); });
+    scope(system.mListenerAccess.reads, &system, packed, mNodes.back().reads);
+    scope(system.mListenerAccess.writes, &system, packed, mNodes.back().writes);
+    if (!mVertices)
+        return;
+    push({index, Kind::Vertices, 0, sf::Time::Zero}, &system, [&system]() { system.getVertices(); });
+    for (sched::Access const& access : system.mFinalizerAccess)
+    {
+        scope(access.reads, &system, packed, mNodes.back().reads);
+        scope(access.writes, &system, packed, mNodes.back().writes);
+    }
+}
+
+#endif
@@ -0,0 +1,479 @@
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SMARTICLES_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SMARTICLES_TARGET_AVX2
+#else
+#define SMARTICLES_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static_assert(sizeof(sf::Time) == sizeof(std::int64_t), "kernels treat sf::Time as its microsecond count");
+
+namespace
+{
+    using SubtractTime = void (*)(std::int64_t*, std::size_t, std::int64_t);
+    using LifetimeAlpha = void (*)(const std::int64_t*, std::size_t, double, std::uint8_t*);
+    using Rotate = void (*)(float*, std::size_t, float, float, float, float);
+
+    struct Grid
+    {
+        const float* xy;
+        int width;
+        int height;
+        float originX, originY;
+        float inverseX, inverseY;
+    };
+    using SampleGrid = void (*)(const float*, std::size_t, Grid const&, float, float*);
+    using Blend = void (*)(std::uint8_t*, const float*, std::size_t, simd::BlendFunction const&);
+
+    struct Kernels
+    {
+        SubtractTime subtractTime;
+        LifetimeAlpha lifetimeAlpha;
+        Rotate rotate;
+        SampleGrid sampleGrid;
+        Blend blend;
+        simd::Level level;
+    };
+
+    // scalar fallbacks, also used for the tails of the vector loops
+
+    void subtractTimeScalar(std::int64_t* lifetimes, std::size_t count, std::int64_t dt)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            lifetimes[i] -= dt;
+    }
+
+    void lifetimeAlphaScalar(const std::int64_t* lifetimes, std::size_t count, double inverseTotal, std::uint8_t* alpha)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const float ratio = static_cast<float>(lifetimes[i] * inverseTotal);
+            alpha[i] = static_cast<std::uint8_t>(255 * std::min(1.0f, std::max(0.0f, ratio)));
+        }
+    }
+
+    //xy pairs, rotated by (cosA, sinA) about (cx, cy)
+    void rotateScalar(float* xy, std::size_t count, float cx, float cy, float cosA, float sinA)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const float dx = xy[2 * i] - cx;
+            const float dy = xy[2 * i + 1] - cy;
+            xy[2 * i] = dx * cosA - dy * sinA + cx;
+            xy[2 * i + 1] = dy * cosA + dx * sinA + cy;
+        }
+    }
+
+    //written so that every step matches the AVX2 lanes exactly, NaN positions included
+    void sampleGridScalar(const float* xy, std::size_t count, Grid const& grid, float scale, float* out)
+    {
+        const float maxX = static_cast<float>(grid.width - 1);
+        const float maxY = static_cast<float>(grid.height - 1);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            float gx = (xy[2 * i] - grid.originX) * grid.inverseX;
+            float gy = (xy[2 * i + 1] - grid.originY) * grid.inverseY;
+            gx = gx > 0.f ? gx : 0.f;
+            gy = gy > 0.f ? gy : 0.f;
+            gx = gx < maxX ? gx : maxX;
+            gy = gy < maxY ? gy : maxY;
+            const int x0 = std::min(static_cast<int>(gx), grid.width - 2);
+            const int y0 = std::min(static_cast<int>(gy), grid.height - 2);
+            const float tx = gx - static_cast<float>(x0);
+            const float ty = gy - static_cast<float>(y0);
+            const float* a = grid.xy + 2 * (y0 * grid.width + x0);
+            const float* c = a + 2 * grid.width;
+            for (int k = 0; k < 2; ++k)
+            {
+                const float top = a[k] + (a[k + 2] - a[k]) * tx;
+                const float bottom = c[k] + (c[k + 2] - c[k]) * tx;
+                out[2 * i + k] += (top + (bottom - top) * ty) * scale;
+            }
+        }
+    }
+
+    //same order of operations as the vector versions, so all levels round alike
+    void blendScalar(std::uint8_t* dst, const float* src, std::size_t count, simd::BlendFunction const& function)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const float* s = src + 4 * i;
+            std::uint8_t* pixel = dst + 4 * i;
+            float d[4];
+            for (int c = 0; c < 4; ++c)
+                d[c] = static_cast<float>(pixel[c]) * (1.f / 255.f);
+            for (int c = 0; c < 4; ++c)
+            {
+                const float (&ws)[5][4] = function.src;
+                const float (&wd)[5][4] = function.dst;
+                const float srcFactor = ws[0][c] + s[c] * ws[1][c] + d[c] * ws[2][c] + s[3] * ws[3][c] + d[3] * ws[4][c];
+                const float dstFactor = wd[0][c] + s[c] * wd[1][c] + d[c] * wd[2][c] + s[3] * wd[3][c] + d[3] * wd[4][c];
+                float value = function.srcSign[c] * s[c] * srcFactor + function.dstSign[c] * d[c] * dstFactor;
+                value = std::min(1.f, std::max(0.f, value));
+                pixel[c] = static_cast<std::uint8_t>(std::nearbyint(value * 255.f));
+            }
+        }
+    }
+
+#ifdef SMARTICLES_X86
+    // int64 -> double without AVX-512: valid for |x| < 2^51 microseconds, i.e. about 71 years of lifetime
+    const double kMagic = 6755399441055744.0; // 2^52 + 2^51
+
+    void subtractTimeSSE2(std::int64_t* lifetimes, std::size_t count, std::int64_t dt)
+    {
+        const __m128i step = _mm_set1_epi64x(dt);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128i* p = reinterpret_cast<__m128i*>(lifetimes + i);
+            _mm_storeu_si128(p, _mm_sub_epi64(_mm_loadu_si128(p), step));
+        }
+        subtractTimeScalar(lifetimes + i, count - i, dt);
+    }
+
+    void lifetimeAlphaSSE2(const std::int64_t* lifetimes, std::size_t count, double inverseTotal, std::uint8_t* alpha)
+    {
+        const __m128i magicBits = _mm_castpd_si128(_mm_set1_pd(kMagic));
+        const __m128d magic = _mm_set1_pd(kMagic);
+        const __m128d scale = _mm_set1_pd(inverseTotal);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 max = _mm_set1_ps(255.f);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i* p = reinterpret_cast<const __m128i*>(lifetimes + i);
+            __m128d lo = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(_mm_loadu_si128(p), magicBits)), magic);
+            __m128d hi = _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(_mm_loadu_si128(p + 1), magicBits)), magic);
+            __m128 ratio = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(lo, scale)), _mm_cvtpd_ps(_mm_mul_pd(hi, scale)));
+            ratio = _mm_min_ps(one, _mm_max_ps(zero, ratio));
+            __m128i value = _mm_cvttps_epi32(_mm_mul_ps(ratio, max));
+            value = _mm_packs_epi32(value, value);
+            value = _mm_packus_epi16(value, value);
+            const int packed = _mm_cvtsi128_si32(value);
+            std::memcpy(alpha + i, &packed, 4);
+        }
+        lifetimeAlphaScalar(lifetimes + i, count - i, inverseTotal, alpha + i);
+    }
+
+    void rotateSSE2(float* xy, std::size_t count, float cx, float cy, float cosA, float sinA)
+    {
+        const __m128 center = _mm_setr_ps(cx, cy, cx, cy);
+        const __m128 c = _mm_set1_ps(cosA);
+        const __m128 s = _mm_setr_ps(-sinA, sinA, -sinA, sinA);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            const __m128 d = _mm_sub_ps(_mm_loadu_ps(xy + 2 * i), center);
+            const __m128 swapped = _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1));
+            const __m128 r = _mm_add_ps(_mm_mul_ps(d, c), _mm_mul_ps(swapped, s));
+            _mm_storeu_ps(xy + 2 * i, _mm_add_ps(r, center));
+        }
+        rotateScalar(xy + 2 * i, count - i, cx, cy, cosA, sinA);
+    }
+
+    void blendSSE2(std::uint8_t* dst, const float* src, std::size_t count, simd::BlendFunction const& function)
+    {
+        __m128 ws[5], wd[5];
+        for (int k = 0; k < 5; ++k)
+        {
+            ws[k] = _mm_loadu_ps(function.src[k]);
+            wd[k] = _mm_loadu_ps(function.dst[k]);
+        }
+        const __m128 srcSign = _mm_loadu_ps(function.srcSign);
+        const __m128 dstSign = _mm_loadu_ps(function.dstSign);
+        const __m128 inverse = _mm_set1_ps(1.f / 255.f);
+        const __m128 max = _mm_set1_ps(255.f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128i bytes = _mm_setzero_si128();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            //one pixel per register, its channels in the lanes
+            int packed;
+            std::memcpy(&packed, dst + 4 * i, 4);
+            const __m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), bytes), bytes);
+            const __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(widened), inverse);
+            const __m128 s = _mm_loadu_ps(src + 4 * i);
+            const __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+            const __m128 da = _mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 srcFactor = _mm_add_ps(ws[0], _mm_mul_ps(s, ws[1]));
+            srcFactor = _mm_add_ps(_mm_add_ps(_mm_add_ps(srcFactor, _mm_mul_ps(d, ws[2])), _mm_mul_ps(sa, ws[3])), _mm_mul_ps(da, ws[4]));
+            __m128 dstFactor = _mm_add_ps(wd[0], _mm_mul_ps(s, wd[1]));
+            dstFactor = _mm_add_ps(_mm_add_ps(_mm_add_ps(dstFactor, _mm_mul_ps(d, wd[2])), _mm_mul_ps(sa, wd[3])), _mm_mul_ps(da, wd[4]));
+            __m128 value = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(srcSign, s), srcFactor), _mm_mul_ps(_mm_mul_ps(dstSign, d), dstFactor));
+            value = _mm_min_ps(one, _mm_max_ps(zero, value));
+            __m128i result = _mm_cvtps_epi32(_mm_mul_ps(value, max));
+            result = _mm_packs_epi32(result, result);
+            result = _mm_packus_epi16(result, result);
+            packed = _mm_cvtsi128_si32(result);
+            std::memcpy(dst + 4 * i, &packed, 4);
+        }
+    }
+
+    SMARTICLES_TARGET_AVX2
+    void subtractTimeAVX2(std::int64_t* lifetimes, std::size_t count, std::int64_t dt)
+    {
+        const __m256i step = _mm256_set1_epi64x(dt);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i* p = reinterpret_cast<__m256i*>(lifetimes + i);
+            _mm256_storeu_si256(p, _mm256_sub_epi64(_mm256_loadu_si256(p), step));
+        }
+        subtractTimeScalar(lifetimes + i, count - i, dt);
+    }
+
+    SMARTICLES_TARGET_AVX2
+    void lifetimeAlphaAVX2(const std::int64_t* lifetimes, std::size_t count, double inverseTotal, std::uint8_t* alpha)
+    {
+        const __m256i magicBits = _mm256_castpd_si256(_mm256_set1_pd(kMagic));
+        const __m256d magic = _mm256_set1_pd(kMagic);
+        const __m256d scale = _mm256_set1_pd(inverseTotal);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256 max = _mm256_set1_ps(255.f);
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i* p = reinterpret_cast<const __m256i*>(lifetimes + i);
+            __m256d lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(_mm256_loadu_si256(p), magicBits)), magic);
+            __m256d hi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(_mm256_loadu_si256(p + 1), magicBits)), magic);
+            __m256 ratio = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_mul_pd(hi, scale)), _mm256_cvtpd_ps(_mm256_mul_pd(lo, scale)));
+            ratio = _mm256_min_ps(one, _mm256_max_ps(zero, ratio));
+            const __m256i value = _mm256_cvttps_epi32(_mm256_mul_ps(ratio, max));
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+            packed = _mm_packus_epi16(packed, packed);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(alpha + i), packed);
+        }
+        lifetimeAlphaScalar(lifetimes + i, count - i, inverseTotal, alpha + i);
+    }
+
+    SMARTICLES_TARGET_AVX2
+    void rotateAVX2(float* xy, std::size_t count, float cx, float cy, float cosA, float sinA)
+    {
+        const __m256 center = _mm256_setr_ps(cx, cy, cx, cy, cx, cy, cx, cy);
+        const __m256 c = _mm256_set1_ps(cosA);
+        const __m256 s = _mm256_setr_ps(-sinA, sinA, -sinA, sinA, -sinA, sinA, -sinA, sinA);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(xy + 2 * i), center);
+            const __m256 swapped = _mm256_permute_ps(d, _MM_SHUFFLE(2, 3, 0, 1));
+            const __m256 r = _mm256_add_ps(_mm256_mul_ps(d, c), _mm256_mul_ps(swapped, s));
+            _mm256_storeu_ps(xy + 2 * i, _mm256_add_ps(r, center));
+        }
+        rotateScalar(xy + 2 * i, count - i, cx, cy, cosA, sinA);
+    }
+
+    SMARTICLES_TARGET_AVX2
+    void sampleGridAVX2(const float* xy, std::size_t count, Grid const& grid, float scale, float* out)
+    {
+        const __m256 originX = _mm256_set1_ps(grid.originX);
+        const __m256 originY = _mm256_set1_ps(grid.originY);
+        const __m256 inverseX = _mm256_set1_ps(grid.inverseX);
+        const __m256 inverseY = _mm256_set1_ps(grid.inverseY);
+        const __m256 maxX = _mm256_set1_ps(static_cast<float>(grid.width - 1));
+        const __m256 maxY = _mm256_set1_ps(static_cast<float>(grid.height - 1));
+        const __m256i lastX = _mm256_set1_epi32(grid.width - 2);
+        const __m256i lastY = _mm256_set1_epi32(grid.height - 2);
+        const __m256i width = _mm256_set1_epi32(grid.width);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256 factor = _mm256_set1_ps(scale);
+        const __m256 zero = _mm256_setzero_ps();
+        //(x0 y0 x1 y1 x2 y2 x3 y3 | x4 y4 ..) -> (x0 x1 x2 x3 x4 ..) and back
+        const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 lo = _mm256_permutevar8x32_ps(_mm256_loadu_ps(xy + 2 * i), evens);
+            const __m256 hi = _mm256_permutevar8x32_ps(_mm256_loadu_ps(xy + 2 * i + 8), evens);
+            const __m256 px = _mm256_permute2f128_ps(lo, hi, 0x20);
+            const __m256 py = _mm256_permute2f128_ps(lo, hi, 0x31);
+
+            //max(value, 0) picks 0 for NaN, like the scalar comparison
+            __m256 gx = _mm256_mul_ps(_mm256_sub_ps(px, originX), inverseX);
+            __m256 gy = _mm256_mul_ps(_mm256_sub_ps(py, originY), inverseY);
+            gx = _mm256_min_ps(_mm256_max_ps(gx, zero), maxX);
+            gy = _mm256_min_ps(_mm256_max_ps(gy, zero), maxY);
+            const __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(gx), lastX);
+            const __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(gy), lastY);
+            const __m256 tx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(x0));
+            const __m256 ty = _mm256_sub_ps(gy, _mm256_cvtepi32_ps(y0));
+
+            //float offsets of the four corners' x components
+            const __m256i a = _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y0, width), x0), 1);
+            const __m256i b = _mm256_add_epi32(a, _mm256_slli_epi32(one, 1));
+            const __m256i c = _mm256_add_epi32(a, _mm256_slli_epi32(width, 1));
+            const __m256i d = _mm256_add_epi32(c, _mm256_slli_epi32(one, 1));
+
+            __m256 result[2];
+            for (int k = 0; k < 2; ++k)
+            {
+                const float* base = grid.xy + k;
+                const __m256 va = _mm256_i32gather_ps(base, a, 4);
+                const __m256 vb = _mm256_i32gather_ps(base, b, 4);
+                const __m256 vc = _mm256_i32gather_ps(base, c, 4);
+                const __m256 vd = _mm256_i32gather_ps(base, d, 4);
+                const __m256 top = _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), tx));
+                const __m256 bottom = _mm256_add_ps(vc, _mm256_mul_ps(_mm256_sub_ps(vd, vc), tx));
+                result[k] = _mm256_mul_ps(_mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), ty)), factor);
+            }
+
+            //interleave back to xy pairs
+            const __m256 first = _mm256_unpacklo_ps(result[0], result[1]);
+            const __m256 second = _mm256_unpackhi_ps(result[0], result[1]);
+            const __m256 outLo = _mm256_permute2f128_ps(first, second, 0x20);
+            const __m256 outHi = _mm256_permute2f128_ps(first, second, 0x31);
+            _mm256_storeu_ps(out + 2 * i, _mm256_add_ps(_mm256_loadu_ps(out + 2 * i), outLo));
+            _mm256_storeu_ps(out + 2 * i + 8, _mm256_add_ps(_mm256_loadu_ps(out + 2 * i + 8), outHi));
+        }
+        sampleGridScalar(xy + 2 * i, count - i, grid, scale, out + 2 * i);
+    }
+
+    SMARTICLES_TARGET_AVX2
+    void blendAVX2(std::uint8_t* dst, const float* src, std::size_t count, simd::BlendFunction const& function)
+    {
+        __m256 ws[5], wd[5];
+        for (int k = 0; k < 5; ++k)
+        {
+            ws[k] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(function.src[k]));
+            wd[k] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(function.dst[k]));
+        }
+        const __m256 srcSign = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(function.srcSign));
+        const __m256 dstSign = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(function.dstSign));
+        const __m256 inverse = _mm256_set1_ps(1.f / 255.f);
+        const __m256 max = _mm256_set1_ps(255.f);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            //two pixels per register, one in each half
+            const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(dst + 4 * i));
+            const __m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed)), inverse);
+            const __m256 s = _mm256_loadu_ps(src + 4 * i);
+            const __m256 sa = _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3));
+            const __m256 da = _mm256_permute_ps(d, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 srcFactor = _mm256_add_ps(ws[0], _mm256_mul_ps(s, ws[1]));
+            srcFactor = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(srcFactor, _mm256_mul_ps(d, ws[2])), _mm256_mul_ps(sa, ws[3])), _mm256_mul_ps(da, ws[4]));
+            __m256 dstFactor = _mm256_add_ps(wd[0], _mm256_mul_ps(s, wd[1]));
+            dstFactor = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(dstFactor, _mm256_mul_ps(d, wd[2])), _mm256_mul_ps(sa, wd[3])), _mm256_mul_ps(da, wd[4]));
+            __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(srcSign, s), srcFactor), _mm256_mul_ps(_mm256_mul_ps(dstSign, d), dstFactor));
+            value = _mm256_min_ps(one, _mm256_max_ps(zero, value));
+            const __m256i rounded = _mm256_cvtps_epi32(_mm256_mul_ps(value, max));
+            __m128i result = _mm_packs_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+            result = _mm_packus_epi16(result, result);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4 * i), result);
+        }
+        blendScalar(dst + 4 * i, src + 4 * i, count - i, function);
+    }
+#endif
+
+    Kernels makeKernels(simd::Level level)
+    {
+        switch (level)
+        {
+#ifdef SMARTICLES_X86
+        case simd::Level::AVX2:
+            return {subtractTimeAVX2, lifetimeAlphaAVX2, rotateAVX2, sampleGridAVX2, blendAVX2, level};
+        case simd::Level::SSE2:
+            return {subtractTimeSSE2, lifetimeAlphaSSE2, rotateSSE2, sampleGridScalar, blendSSE2, level};
+#endif
+        default:
+            return {subtractTimeScalar, lifetimeAlphaScalar, rotateScalar, sampleGridScalar, blendScalar, simd::Level::Scalar};
+        }
+    }
+
+    Kernels& kernels()
+    {
+        static Kernels table = makeKernels(simd::detectLevel());
+        return table;
+    }
+}
+
+namespace simd
+{
+    Level detectLevel()
+    {
+#if defined(SMARTICLES_X86) && defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7)
+        {
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+            const bool sse2 = (info[3] & (1 << 26)) != 0;
+            __cpuidex(info, 7, 0);
+            const bool avx2 = (info[1] & (1 << 5)) != 0;
+            if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6)
+                return Level::AVX2;
+            if (sse2)
+                return Level::SSE2;
+        }
+        return Level::Scalar;
+#elif defined(SMARTICLES_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Level::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return Level::SSE2;
+        return Level::Scalar;
+#else
+        return Level::Scalar;
+#endif
+    }
+
+    Level getLevel()
+    {
+        return kernels().level;
+    }
+
+    void setLevel(Level level)
+    {
+        kernels() = makeKernels(std::min(level, detectLevel()));
+    }
+
+    void subtractTime(sf::Time* lifetimes, std::size_t count, sf::Time dt)
+    {
+        kernels().subtractTime(reinterpret_cast<std::int64_t*>(lifetimes), count, dt.asMicroseconds());
+    }
+
+    void lifetimeAlpha(const sf::Time* lifetimes, std::size_t count, sf::Time total, std::uint8_t* alpha)
+    {
+        const double inverseTotal = total > sf::Time::Zero ? 1.0 / static_cast<double>(total.asMicroseconds()) : 0.0;
+        kernels().lifetimeAlpha(reinterpret_cast<const std::int64_t*>(lifetimes), count, inverseTotal, alpha);
+    }
+
+    void rotate(sf::Vector2f* positions, std::size_t count, sf::Vector2f center, float angle)
+    {
+        static_assert(sizeof(sf::Vector2f) == 2 * sizeof(float), "positions are read as packed xy pairs");
+        kernels().rotate(reinterpret_cast<float*>(positions), count, center.x, center.y, std::cos(angle), std::sin(angle));
+    }
+
+    void sampleGrid(const sf::Vector2f* positions, std::size_t count, const sf::Vector2f* grid, unsigned width, unsigned height,
+                    sf::Vector2f origin, sf::Vector2f inverseCell, float scale, sf::Vector2f* out)
+    {
+        const Grid table{reinterpret_cast<const float*>(grid), static_cast<int>(width), static_cast<int>(height),
+                         origin.x, origin.y, inverseCell.x, inverseCell.y};
+        kernels().sampleGrid(reinterpret_cast<const float*>(positions), count, table, scale, reinterpret_cast<float*>(out));
+    }
+
+    void blend(std::uint8_t* dst, std::size_t dstStride, const float* src, std::size_t srcStride, std::size_t width, std::size_t rows,
+               BlendFunction const& function)
+    {
+        const Blend kernel = kernels().blend;
+        for (std::size_t row = 0; row < rows; ++row)
+            kernel(dst + row * dstStride, src + row * srcStride, width, function);
+    }
+}
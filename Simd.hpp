@@ -0,0 +1,58 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized kernels for the built-in per-particle passes.
+// Each kernel has a scalar, an SSE2 and an AVX2 version; the widest one the CPU supports is picked
+// the first time a kernel runs. Kernels work on contiguous arrays, i.e. the columns of storage::SoA.
+namespace simd
+{
+    enum class Level
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    //best level supported by this CPU
+    Level detectLevel();
+    //level the kernels currently dispatch to
+    Level getLevel();
+    //forces a level, e.g. to compare against the scalar fallback; clamped to what the CPU supports
+    void setLevel(Level level);
+
+    // A blend equation as per channel (r, g, b, a) weights, so that one kernel covers every sf::BlendMode:
+    // a factor is one + src * s + dst * d + srcAlpha * sa + dstAlpha * da with weights of -1, 0 or 1,
+    // and the result is srcSign * src * srcFactor + dstSign * dst * dstFactor.
+    struct BlendFunction
+    {
+        float src[5][4];    //weights of one, s, d, sa, da
+        float dst[5][4];
+        float srcSign[4];
+        float dstSign[4];
+    };
+
+    //lifetimes[i] -= dt
+    void subtractTime(sf::Time* lifetimes, std::size_t count, sf::Time dt);
+    //alpha[i] = 255 * clamp(lifetimes[i] / total, 0, 1)
+    void lifetimeAlpha(const sf::Time* lifetimes, std::size_t count, sf::Time total, std::uint8_t* alpha);
+    //rotates every position by angle (radians) about center
+    void rotate(sf::Vector2f* positions, std::size_t count, sf::Vector2f center, float angle);
+    //out[i] += scale * bilinear sample of a width x height grid of vectors (row major, width and height >= 2)
+    //at positions[i]; cell converts a position into grid units, positions outside are clamped to the edge.
+    //out may be positions itself. There is no gather before AVX2, so SSE2 runs the scalar version.
+    void sampleGrid(const sf::Vector2f* positions, std::size_t count, const sf::Vector2f* grid, unsigned width, unsigned height,
+                    sf::Vector2f origin, sf::Vector2f inverseCell, float scale, sf::Vector2f* out);
+    //blends a block of width x rows pixels of src (RGBA, 4 floats in [0, 1] each) into dst (RGBA, 8 bits per channel)
+    //like an 8 bit framebuffer: dst = round(255 * clamp(function(src, dst / 255), 0, 1)).
+    //Rows are dstStride bytes apart in dst and srcStride floats apart in src, 0 to blend the same row every time.
+    void blend(std::uint8_t* dst, std::size_t dstStride, const float* src, std::size_t srcStride, std::size_t width, std::size_t rows,
+               BlendFunction const& function);
+}
+
+#endif
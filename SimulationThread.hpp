@@ -0,0 +1,260 @@
+#ifndef SIMULATIONTHREAD_HPP
+#define SIMULATIONTHREAD_HPP
+
+#include "ParticleSystem.hpp"
+#include "TripleBuffer.hpp"
+#include "Stats.hpp"
+
+#include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What the render thread gets from one simulation step.
+struct RenderSnapshot
+{
+    std::vector<sf::Vertex> vertices;
+    std::vector<sf::Vector2f> previous;     //one per quad, where its particle was a step earlier; empty without interpolation
+    ParticleStats stats;
+    std::size_t particles = 0;
+    std::uint64_t step = 0;                 //steps simulated so far
+    std::int64_t published = 0;             //steady clock, nanoseconds
+};
+
+// Runs a ParticleSystem on a thread of its own at a fixed timestep.
+// After every step the quads (and stats) are copied into a snapshot and handed to the render thread
+// through a TripleBuffer, so drawing never waits for the simulation and a slow step never stalls a frame;
+// the render thread simply keeps drawing the latest finished snapshot.
+// While the thread runs, the system belongs to it: touch it only through setStep() and post().
+// If the simulation falls behind it catches up by a few steps at most and then drops the missing time.
+template <typename ParticleType = BaseParticle<>, typename Storage = storage::AoS>
+class SimulationThread : public sf::Drawable
+{
+public:
+    using System = ParticleSystem<ParticleType, Storage>;
+    using Step = std::function<void(sf::Time)>;
+public:
+    SimulationThread(System& system, sf::Time timestep);
+    ~SimulationThread();
+    SimulationThread(SimulationThread const&) = delete;
+    SimulationThread& operator=(SimulationThread const&) = delete;
+public:
+    //called on the simulation thread before every system.update(), e.g. to update Emitters; set it before start()
+    void setStep(Step step);
+    //draw particles part of the way between the last two steps, by the time since the last one; set it before start()
+    void setInterpolation(bool enabled);
+    void setMaxCatchUp(unsigned steps);
+    void start();
+    void stop();
+    bool isRunning() const;
+    //runs function on the simulation thread before its next step
+    void post(std::function<void(System&)> function);
+    //render thread: the latest snapshot
+    const RenderSnapshot& getSnapshot() const;
+private:
+    void run();
+    void publish();
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+private:
+    System& mSystem;
+    sf::Time mTimestep;
+    Step mStep;
+    bool mInterpolate = false;
+    unsigned mMaxCatchUp = 4;
+
+    std::thread mThread;
+    std::atomic<bool> mRunning{false};
+    std::uint64_t mSteps = 0;
+
+    std::mutex mPostMutex;
+    std::vector<std::function<void(System&)>> mPosted;
+
+    //the view of the last draw(), for culling on the simulation thread
+    mutable std::mutex mViewMutex;
+    mutable sf::FloatRect mView;
+    mutable bool mHasView = false;
+
+    mutable TripleBuffer<RenderSnapshot> mSnapshots;
+    mutable std::vector<sf::Vertex> mInterpolated;
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename Storage>
+SimulationThread<ParticleType, Storage>::SimulationThread(System& system, sf::Time timestep)
+: mSystem(system)
+, mTimestep(timestep)
+, mStep()
+{
+
+}
+
+template <typename ParticleType, typename Storage>
+SimulationThread<ParticleType, Storage>::~SimulationThread()
+{
+    stop();
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::setStep(Step step)
+{
+    mStep = std::move(step);
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::setInterpolation(bool enabled)
+{
+    mInterpolate = enabled;
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::setMaxCatchUp(unsigned steps)
+{
+    mMaxCatchUp = std::max(steps, 1u);
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::start()
+{
+    if (mRunning.exchange(true))
+        return;
+    mSystem.setPreviousPositionsEnabled(mInterpolate);
+    mThread = std::thread(&SimulationThread::run, this);
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::stop()
+{
+    mRunning.store(false);
+    if (mThread.joinable())
+        mThread.join();
+}
+
+template <typename ParticleType, typename Storage>
+bool SimulationThread<ParticleType, Storage>::isRunning() const
+{
+    return mRunning.load();
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::post(std::function<void(System&)> function)
+{
+    std::lock_guard<std::mutex> lock(mPostMutex);
+    mPosted.push_back(std::move(function));
+}
+
+template <typename ParticleType, typename Storage>
+const RenderSnapshot& SimulationThread<ParticleType, Storage>::getSnapshot() const
+{
+    mSnapshots.acquire();
+    return mSnapshots.front();
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::run()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto timestep = std::chrono::microseconds(mTimestep.asMicroseconds());
+    auto next = Clock::now();
+    std::vector<std::function<void(System&)>> posted;
+
+    while (mRunning.load(std::memory_order_relaxed))
+    {
+        {
+            std::lock_guard<std::mutex> lock(mPostMutex);
+            posted.swap(mPosted);
+        }
+        for (auto& function : posted)
+            function(mSystem);
+        posted.clear();
+
+        unsigned steps = 0;
+        while (Clock::now() >= next && steps < mMaxCatchUp)
+        {
+            if (mStep)
+                mStep(mTimestep);
+            mSystem.update(mTimestep);
+            next += timestep;
+            ++steps;
+            ++mSteps;
+        }
+        //too far behind: drop the time instead of snowballing
+        if (Clock::now() >= next)
+            next = Clock::now() + timestep;
+        if (steps)
+            publish();
+        std::this_thread::sleep_until(next);
+    }
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::publish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mViewMutex);
+        if (mHasView)
+            mSystem.setCullRect(mView);
+    }
+    const sf::VertexArray& vertices = mSystem.getVertices();
+    RenderSnapshot& snapshot = mSnapshots.back();
+    const std::size_t count = vertices.getVertexCount();
+    snapshot.vertices.resize(count);
+    if (count)
+        std::copy(&vertices[0], &vertices[0] + count, snapshot.vertices.begin());
+    if (mInterpolate)
+        snapshot.previous = mSystem.getPreviousPositions();
+    else
+        snapshot.previous.clear();
+    snapshot.stats = mSystem.getStats();
+    snapshot.particles = mSystem.getParticleCount();
+    snapshot.step = mSteps;
+    snapshot.published = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    mSnapshots.publish();
+}
+
+template <typename ParticleType, typename Storage>
+void SimulationThread<ParticleType, Storage>::draw(sf::RenderTarget &target, sf::RenderStates states) const
+{
+    {
+        const sf::FloatRect world = target.getView().getInverseTransform().transformRect({-1.f, -1.f, 2.f, 2.f});
+        std::lock_guard<std::mutex> lock(mViewMutex);
+        mView = states.transform.getInverse().transformRect(world);
+        mHasView = true;
+    }
+
+    const RenderSnapshot& snapshot = getSnapshot();
+    if (snapshot.vertices.empty())
+        return;
+    states.texture = mSystem.getTexture();
+    states.blendMode = mSystem.getBlendMode();
+    if (!mInterpolate || snapshot.previous.size() * 4 != snapshot.vertices.size())
+    {
+        target.draw(snapshot.vertices.data(), snapshot.vertices.size(), sf::Quads, states);
+        return;
+    }
+
+    //each quad is moved back from where its particle is now towards where it was, by the part of the step not yet shown
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    const float alpha = std::min(1.f, std::max(0.f, static_cast<float>(now - snapshot.published) / (mTimestep.asMicroseconds() * 1000.f)));
+    mInterpolated.assign(snapshot.vertices.begin(), snapshot.vertices.end());
+    for (std::size_t q = 0; q < snapshot.previous.size(); ++q)
+    {
+        sf::Vertex* quad = &mInterpolated[4 * q];
+        const sf::Vector2f center = (quad[0].position + quad[2].position) / 2.f;
+        const sf::Vector2f offset = (snapshot.previous[q] - center) * (1.f - alpha);
+        for (int v = 0; v < 4; ++v)
+            quad[v].position += offset;
+    }
+    target.draw(mInterpolated.data(), mInterpolated.size(), sf::Quads, states);
+}
+
+#endif
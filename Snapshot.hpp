@@ -0,0 +1,294 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "Emitter.hpp"
+#include "ParticleSystem.hpp"
+#include "Random.hpp"
+
+#include <SFML/System/Time.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// A read-only view of a whole file, mapped into memory (mmap, or MapViewOfFile on Windows).
+// Pages are only read from disk when touched, and nothing is copied until the caller copies it.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(std::string const& path);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+public:
+    bool open(std::string const& path);
+    void close();
+    bool isOpen() const;
+    const std::uint8_t* data() const;
+    std::size_t size() const;
+private:
+    const std::uint8_t* mData = nullptr;
+    std::size_t mSize = 0;
+#ifdef _WIN32
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+#endif
+};
+
+// Binary snapshots of a ParticleSystem's particles, and optionally of an Emitter feeding it, e.g. to ship
+// effects that are already warmed up instead of simulating their first minute at load.
+// The file is the header, the element size of every storage column, then every column's array as it is
+// in memory (each starting on a 16 byte boundary), then the emitter block if there is one.
+// save() streams the arrays straight out of the storage; load() maps the file and copies each column in
+// with a single memcpy, no per-particle parsing. Snapshots are only read back by the same particle type and
+// storage on a machine of the same byte order; load() checks all that, and that the particles fit the file and
+// the system's capacity, and returns false otherwise, leaving the system and emitter untouched. Particles are copied byte for byte, so every column must be
+// trivially copyable.
+struct SnapshotHeader
+{
+    char magic[4];                  //"SMPS"
+    std::uint32_t version;
+    std::uint32_t byteOrder;        //kByteOrder as the writer saw it
+    std::uint32_t storage;          //0 AoS, 1 SoA, 2 Compact
+    std::uint32_t particleSize;     //sizeof(ParticleType)
+    std::uint32_t columns;
+    std::uint64_t count;
+    std::uint32_t emitter;          //1 if an emitter block follows the particles
+    float codecStep;                //storage::Compact: the quant::Codec the records were packed with, 0 otherwise
+    float codecOrigin[2];
+    std::int64_t codecTick;         //microseconds
+};
+
+namespace snapshot
+{
+    constexpr std::uint32_t kVersion = 2;
+    constexpr std::uint32_t kByteOrder = 0x01020304;
+    constexpr std::size_t kAlignment = 16;
+
+    template <typename ParticleType, typename Storage>
+    bool save(std::string const& path, ParticleSystem<ParticleType, Storage> const& system);
+    //also stores the emitter's accumulated time, rate, default particle and random state
+    template <typename ParticleType, typename InheritFrom, typename Storage>
+    bool save(std::string const& path, ParticleSystem<ParticleType, Storage> const& system,
+              Emitter<ParticleType, InheritFrom, Storage> const& emitter);
+
+    template <typename ParticleType, typename Storage>
+    bool load(std::string const& path, ParticleSystem<ParticleType, Storage>& system);
+    //the file must have an emitter block
+    template <typename ParticleType, typename InheritFrom, typename Storage>
+    bool load(std::string const& path, ParticleSystem<ParticleType, Storage>& system,
+              Emitter<ParticleType, InheritFrom, Storage>& emitter);
+}
+
+namespace snapshot::detail
+{
+    template <typename ParticleType>
+    struct EmitterState
+    {
+        sf::Int64 accumulated;      //microseconds
+        float rate;
+        Rng rng;
+        ParticleType defaultParticle;
+    };
+
+    inline std::size_t padding(std::size_t offset)
+    {
+        return (kAlignment - offset % kAlignment) % kAlignment;
+    }
+
+    template <typename Storage>
+    constexpr std::uint32_t storageId()
+    {
+        return std::is_same_v<Storage, storage::SoA> ? 1 : std::is_same_v<Storage, storage::Compact> ? 2 : 0;
+    }
+
+    template <typename Container>
+    std::vector<std::uint32_t> columnSizes(Container const& particles)
+    {
+        std::vector<std::uint32_t> sizes;
+        storage::forEachColumn(particles, [&sizes](auto const& column)
+        {
+            using Element = typename std::decay_t<decltype(column)>::value_type;
+            static_assert(std::is_trivially_copyable_v<Element>, "snapshots copy particles byte for byte");
+            sizes.push_back(static_cast<std::uint32_t>(sizeof(Element)));
+        });
+        return sizes;
+    }
+
+    template <typename ParticleType, typename Storage>
+    bool write(std::string const& path, ParticleSystem<ParticleType, Storage> const& system, EmitterState<ParticleType> const* emitter)
+    {
+        static_assert(std::is_trivially_copyable_v<ParticleType>, "snapshots copy particles byte for byte");
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        const auto& particles = system.getParticles();
+        const std::vector<std::uint32_t> sizes = columnSizes(particles);
+        SnapshotHeader header = {{'S', 'M', 'P', 'S'}, kVersion, kByteOrder, storageId<Storage>(),
+                                 static_cast<std::uint32_t>(sizeof(ParticleType)), static_cast<std::uint32_t>(sizes.size()),
+                                 static_cast<std::uint64_t>(particles.size()), emitter ? 1u : 0u, 0.f, {0.f, 0.f}, 0};
+        if constexpr (std::is_same_v<Storage, storage::Compact>)
+        {
+            const quant::Codec& codec = particles.getCodec();
+            header.codecStep = codec.step;
+            header.codecOrigin[0] = codec.origin.x;
+            header.codecOrigin[1] = codec.origin.y;
+            header.codecTick = codec.tick.asMicroseconds();
+        }
+
+        std::size_t offset = 0;
+        const char zeros[kAlignment] = {};
+        auto put = [&file, &offset](const void* data, std::size_t bytes)
+        {
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            offset += bytes;
+        };
+        auto align = [&put, &offset, &zeros]() { put(zeros, padding(offset)); };
+
+        put(&header, sizeof(header));
+        put(sizes.data(), sizes.size() * sizeof(std::uint32_t));
+        storage::forEachColumn(particles, [&put, &align](auto const& column)
+        {
+            align();
+            put(column.data(), column.size() * sizeof(column[0]));
+        });
+        if (emitter)
+        {
+            align();
+            put(&emitter->accumulated, sizeof(emitter->accumulated));
+            put(&emitter->rate, sizeof(emitter->rate));
+            put(&emitter->rng, sizeof(emitter->rng));
+            put(&emitter->defaultParticle, sizeof(emitter->defaultParticle));
+        }
+        return static_cast<bool>(file.flush());
+    }
+
+    template <typename ParticleType, typename Storage>
+    bool read(std::string const& path, ParticleSystem<ParticleType, Storage>& system, EmitterState<ParticleType>* emitter)
+    {
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(SnapshotHeader))
+            return false;
+
+        SnapshotHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        const std::vector<std::uint32_t> sizes = columnSizes(system.getParticles());
+        if (std::memcmp(header.magic, "SMPS", 4) != 0 || header.version != kVersion || header.byteOrder != kByteOrder
+            || header.storage != storageId<Storage>() || header.particleSize != sizeof(ParticleType)
+            || header.columns != sizes.size() || (emitter && !header.emitter))
+            return false;
+        //packed records only mean something with the codec they were packed with
+        quant::Codec codec;
+        if constexpr (std::is_same_v<Storage, storage::Compact>)
+        {
+            if (!(header.codecStep > 0.f) || header.codecTick <= 0)
+                return false;
+            codec.step = header.codecStep;
+            codec.origin = {header.codecOrigin[0], header.codecOrigin[1]};
+            codec.tick = sf::microseconds(header.codecTick);
+        }
+        if (file.size() < sizeof(header) + sizes.size() * sizeof(std::uint32_t)
+            || std::memcmp(file.data() + sizeof(header), sizes.data(), sizes.size() * sizeof(std::uint32_t)) != 0)
+            return false;
+
+        //the count is untrusted: no more than the system may hold, and checked against what is left of the
+        //file column by column before anything is multiplied or allocated
+        if (header.count > std::numeric_limits<std::size_t>::max()
+            || (system.getCapacity() != 0 && header.count > system.getCapacity()))
+            return false;
+        const std::size_t count = static_cast<std::size_t>(header.count);
+        std::vector<std::size_t> starts;
+        std::size_t offset = sizeof(header) + sizes.size() * sizeof(std::uint32_t);
+        for (std::uint32_t size : sizes)
+        {
+            offset += padding(offset);
+            if (offset > file.size() || count > (file.size() - offset) / size)
+                return false;
+            starts.push_back(offset);
+            offset += count * size;
+        }
+        //the writer only pads the last column when an emitter block follows it
+        const std::size_t emitterBytes = sizeof(sf::Int64) + sizeof(float) + sizeof(Rng) + sizeof(ParticleType);
+        if (header.emitter)
+            offset += padding(offset);
+        if (file.size() < offset + (header.emitter ? emitterBytes : 0))
+            return false;
+
+        system.assignParticles(count, [&file, &starts, &codec, count](auto& particles)
+        {
+            //emptied first, so that setCodec() has nothing to pack again
+            if constexpr (std::is_same_v<Storage, storage::Compact>)
+            {
+                particles.clear();
+                particles.setCodec(codec);
+                particles.resize(count);
+            }
+            std::size_t index = 0;
+            storage::forEachColumn(particles, [&file, &starts, &index](auto& column)
+            {
+                if (!column.empty())
+                    std::memcpy(static_cast<void*>(column.data()), file.data() + starts[index], column.size() * sizeof(column[0]));
+                ++index;
+            });
+        });
+
+        if (emitter)
+        {
+            const std::uint8_t* block = file.data() + offset;
+            std::memcpy(&emitter->accumulated, block, sizeof(emitter->accumulated));
+            block += sizeof(emitter->accumulated);
+            std::memcpy(&emitter->rate, block, sizeof(emitter->rate));
+            block += sizeof(emitter->rate);
+            std::memcpy(static_cast<void*>(&emitter->rng), block, sizeof(emitter->rng));
+            block += sizeof(emitter->rng);
+            std::memcpy(static_cast<void*>(&emitter->defaultParticle), block, sizeof(emitter->defaultParticle));
+        }
+        return true;
+    }
+}
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename Storage>
+bool snapshot::save(std::string const& path, ParticleSystem<ParticleType, Storage> const& system)
+{
+    return detail::write<ParticleType, Storage>(path, system, nullptr);
+}
+
+template <typename ParticleType, typename InheritFrom, typename Storage>
+bool snapshot::save(std::string const& path, ParticleSystem<ParticleType, Storage> const& system,
+                    Emitter<ParticleType, InheritFrom, Storage> const& emitter)
+{
+    const detail::EmitterState<ParticleType> state = {emitter.getAccumulatedTime().asMicroseconds(), emitter.getEmissionRate(),
+                                                      emitter.getRng(), emitter.getDefaultParticle()};
+    return detail::write(path, system, &state);
+}
+
+template <typename ParticleType, typename Storage>
+bool snapshot::load(std::string const& path, ParticleSystem<ParticleType, Storage>& system)
+{
+    return detail::read<ParticleType, Storage>(path, system, nullptr);
+}
+
+template <typename ParticleType, typename InheritFrom, typename Storage>
+bool snapshot::load(std::string const& path, ParticleSystem<ParticleType, Storage>& system,
+                    Emitter<ParticleType, InheritFrom, Storage>& emitter)
+{
+    detail::EmitterState<ParticleType> state = {0, 0.f, emitter.getRng(), emitter.getDefaultParticle()};
+    if (!detail::read(path, system, &state))
+        return false;
+    emitter.setAccumulatedTime(sf::microseconds(state.accumulated));
+    emitter.setEmissionRate(state.rate);
+    emitter.getRng() = state.rng;
+    emitter.setDefaultParticle(state.defaultParticle);
+    return true;
+}
+
+#endif
@@ -0,0 +1,543 @@
+#include "SoftwareRenderer.hpp"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace
+{
+    //a quad's corner in framebuffer pixels, its texture coordinates and its color in [0, 1]
+    struct Corner
+    {
+        float x, y;
+        float u, v;
+        float color[4];
+    };
+
+    struct Source
+    {
+        const std::uint8_t* texels;     //null for untextured systems
+        int width;
+        int height;
+        bool smooth;
+    };
+
+    //the part of the framebuffer a tile may draw to, [left, right) x [top, bottom)
+    struct Target
+    {
+        std::uint8_t* pixels;
+        std::size_t stride;
+        int left, top, right, bottom;
+    };
+
+    void addWeights(sf::BlendMode::Factor factor, float (&weights)[5][4], int channel)
+    {
+        switch (factor)
+        {
+        case sf::BlendMode::Zero:
+            break;
+        case sf::BlendMode::One:
+            weights[0][channel] = 1.f;
+            break;
+        case sf::BlendMode::SrcColor:
+            weights[1][channel] = 1.f;
+            break;
+        case sf::BlendMode::OneMinusSrcColor:
+            weights[0][channel] = 1.f;
+            weights[1][channel] = -1.f;
+            break;
+        case sf::BlendMode::DstColor:
+            weights[2][channel] = 1.f;
+            break;
+        case sf::BlendMode::OneMinusDstColor:
+            weights[0][channel] = 1.f;
+            weights[2][channel] = -1.f;
+            break;
+        case sf::BlendMode::SrcAlpha:
+            weights[3][channel] = 1.f;
+            break;
+        case sf::BlendMode::OneMinusSrcAlpha:
+            weights[0][channel] = 1.f;
+            weights[3][channel] = -1.f;
+            break;
+        case sf::BlendMode::DstAlpha:
+            weights[4][channel] = 1.f;
+            break;
+        case sf::BlendMode::OneMinusDstAlpha:
+            weights[0][channel] = 1.f;
+            weights[4][channel] = -1.f;
+            break;
+        }
+    }
+
+    simd::BlendFunction makeBlendFunction(sf::BlendMode const& mode)
+    {
+        simd::BlendFunction function = {};
+        for (int c = 0; c < 4; ++c)
+        {
+            const bool alpha = c == 3;
+            addWeights(alpha ? mode.alphaSrcFactor : mode.colorSrcFactor, function.src, c);
+            addWeights(alpha ? mode.alphaDstFactor : mode.colorDstFactor, function.dst, c);
+            switch (alpha ? mode.alphaEquation : mode.colorEquation)
+            {
+            case sf::BlendMode::Subtract:
+                function.srcSign[c] = 1.f;
+                function.dstSign[c] = -1.f;
+                break;
+            case sf::BlendMode::ReverseSubtract:
+                function.srcSign[c] = -1.f;
+                function.dstSign[c] = 1.f;
+                break;
+            default:
+                //Min and Max (SFML 2.6) don't fit weighted factors and are blended as Add
+                function.srcSign[c] = 1.f;
+                function.dstSign[c] = 1.f;
+                break;
+            }
+        }
+        return function;
+    }
+
+    //the texel at (u, v) (in texture pixels, clamped to the edge) times color, into out
+    void shade(Source const& source, float u, float v, const float* color, float* out)
+    {
+        if (!source.texels)
+        {
+            for (int c = 0; c < 4; ++c)
+                out[c] = color[c];
+            return;
+        }
+        const float scale = 1.f / 255.f;
+        const int lastX = source.width - 1;
+        const int lastY = source.height - 1;
+        //clamped before converting to int, NaN included
+        u = std::min(static_cast<float>(source.width), std::max(-1.f, u));
+        v = std::min(static_cast<float>(source.height), std::max(-1.f, v));
+        if (!source.smooth)
+        {
+            const int x = std::min(lastX, std::max(0, static_cast<int>(std::floor(u))));
+            const int y = std::min(lastY, std::max(0, static_cast<int>(std::floor(v))));
+            const std::uint8_t* texel = source.texels + 4 * (static_cast<std::size_t>(y) * source.width + x);
+            for (int c = 0; c < 4; ++c)
+                out[c] = texel[c] * scale * color[c];
+            return;
+        }
+        //bilinear between the four nearest texel centers
+        const float fx = std::floor(u - 0.5f);
+        const float fy = std::floor(v - 0.5f);
+        const float tx = u - 0.5f - fx;
+        const float ty = v - 0.5f - fy;
+        const int x0 = std::min(lastX, std::max(0, static_cast<int>(fx)));
+        const int x1 = std::min(lastX, std::max(0, static_cast<int>(fx) + 1));
+        const int y0 = std::min(lastY, std::max(0, static_cast<int>(fy)));
+        const int y1 = std::min(lastY, std::max(0, static_cast<int>(fy) + 1));
+        const std::uint8_t* row0 = source.texels + 4 * static_cast<std::size_t>(y0) * source.width;
+        const std::uint8_t* row1 = source.texels + 4 * static_cast<std::size_t>(y1) * source.width;
+        for (int c = 0; c < 4; ++c)
+        {
+            const float top = row0[4 * x0 + c] + (row0[4 * x1 + c] - row0[4 * x0 + c]) * tx;
+            const float bottom = row1[4 * x0 + c] + (row1[4 * x1 + c] - row1[4 * x0 + c]) * tx;
+            out[c] = (top + (bottom - top) * ty) * scale * color[c];
+        }
+    }
+
+    //an axis-aligned quad of one color: x0 and x1 are the x of its left and right corners (in ParticleSystem's
+    //order), y0 and y1 the y of its top and bottom ones, with u depending on x only and v on y only
+    struct Rect
+    {
+        float x0, x1, y0, y1;
+        float u0, u1, v0, v1;
+        float color[4];
+    };
+
+    bool isAxisAligned(const sf::Vertex* quad, const float (&x)[4], const float (&y)[4])
+    {
+        return y[0] == y[1] && y[2] == y[3] && x[0] == x[3] && x[1] == x[2]
+            && quad[0].texCoords.y == quad[1].texCoords.y && quad[2].texCoords.y == quad[3].texCoords.y
+            && quad[0].texCoords.x == quad[3].texCoords.x && quad[1].texCoords.x == quad[2].texCoords.x
+            && quad[0].color == quad[1].color && quad[0].color == quad[2].color && quad[0].color == quad[3].color;
+    }
+
+    //the pixels whose centers are in [left, right) x [top, bottom), like the two triangles would cover them
+    void drawRect(Target const& target, Source const& source, simd::BlendFunction const& blend, Rect const& quad, float* span)
+    {
+        const float left = std::min(quad.x0, quad.x1), right = std::max(quad.x0, quad.x1);
+        const float top = std::min(quad.y0, quad.y1), bottom = std::max(quad.y0, quad.y1);
+        const int x0 = static_cast<int>(std::max(static_cast<float>(target.left), std::ceil(left - 0.5f)));
+        const int x1 = static_cast<int>(std::min(static_cast<float>(target.right), std::ceil(right - 0.5f)));
+        const int y0 = static_cast<int>(std::max(static_cast<float>(target.top), std::ceil(top - 0.5f)));
+        const int y1 = static_cast<int>(std::min(static_cast<float>(target.bottom), std::ceil(bottom - 0.5f)));
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        const float du = (quad.u1 - quad.u0) / (quad.x1 - quad.x0);
+        const float dv = (quad.v1 - quad.v0) / (quad.y1 - quad.y0);
+        const std::size_t width = static_cast<std::size_t>(x1 - x0);
+        const std::size_t rows = static_cast<std::size_t>(y1 - y0);
+        //untextured quads are one color throughout, so a single row is shaded and blended into every row
+        for (std::size_t row = 0; row < (source.texels ? rows : 1); ++row)
+        {
+            const float v = quad.v0 + (static_cast<float>(y0 + static_cast<int>(row)) + 0.5f - quad.y0) * dv;
+            float* out = span + 4 * width * row;
+            for (int x = x0; x < x1; ++x)
+            {
+                const float u = quad.u0 + (static_cast<float>(x) + 0.5f - quad.x0) * du;
+                shade(source, u, v, quad.color, out + 4 * (x - x0));
+            }
+        }
+        simd::blend(target.pixels + y0 * target.stride + 4 * static_cast<std::size_t>(x0), target.stride,
+                    span, source.texels ? 4 * width : 0, width, rows, blend);
+    }
+
+    float edge(Corner const& from, Corner const& to, float x, float y)
+    {
+        return (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x);
+    }
+
+    //with the triangle wound so that its area is positive, top edges run in +x and left edges in -y
+    bool isTopLeft(Corner const& from, Corner const& to)
+    {
+        const float dy = to.y - from.y;
+        return dy < 0.f || (dy == 0.f && to.x > from.x);
+    }
+
+    //pixels whose centers are inside, or on a top or left edge, so that triangles sharing an edge never both draw a pixel
+    void drawTriangle(Target const& target, Source const& source, simd::BlendFunction const& blend,
+                      Corner const& a, Corner b, Corner c, float* span)
+    {
+        float area = edge(a, b, c.x, c.y);
+        if (!(area != 0.f))
+            return;
+        if (area < 0.f)
+        {
+            std::swap(b, c);
+            area = -area;
+        }
+        const bool topLeft0 = isTopLeft(b, c), topLeft1 = isTopLeft(c, a), topLeft2 = isTopLeft(a, b);
+        const float inverse = 1.f / area;
+
+        const float left = std::min(a.x, std::min(b.x, c.x)), right = std::max(a.x, std::max(b.x, c.x));
+        const float top = std::min(a.y, std::min(b.y, c.y)), bottom = std::max(a.y, std::max(b.y, c.y));
+        const int x0 = static_cast<int>(std::max(static_cast<float>(target.left), std::ceil(left - 0.5f)));
+        const int x1 = static_cast<int>(std::min(static_cast<float>(target.right - 1), std::floor(right - 0.5f)));
+        const int y0 = static_cast<int>(std::max(static_cast<float>(target.top), std::ceil(top - 0.5f)));
+        const int y1 = static_cast<int>(std::min(static_cast<float>(target.bottom - 1), std::floor(bottom - 0.5f)));
+        for (int y = y0; y <= y1; ++y)
+        {
+            const float py = static_cast<float>(y) + 0.5f;
+            //a triangle covers one run of every row
+            int first = x0;
+            std::size_t count = 0;
+            for (int x = x0; x <= x1; ++x)
+            {
+                const float px = static_cast<float>(x) + 0.5f;
+                const float w0 = edge(b, c, px, py), w1 = edge(c, a, px, py), w2 = edge(a, b, px, py);
+                const bool inside = (w0 > 0.f || (w0 == 0.f && topLeft0)) && (w1 > 0.f || (w1 == 0.f && topLeft1))
+                                 && (w2 > 0.f || (w2 == 0.f && topLeft2));
+                if (!inside)
+                {
+                    if (count != 0)
+                        break;
+                    continue;
+                }
+                if (count == 0)
+                    first = x;
+                const float l0 = w0 * inverse, l1 = w1 * inverse, l2 = w2 * inverse;
+                float color[4];
+                for (int k = 0; k < 4; ++k)
+                    color[k] = l0 * a.color[k] + l1 * b.color[k] + l2 * c.color[k];
+                shade(source, l0 * a.u + l1 * b.u + l2 * c.u, l0 * a.v + l1 * b.v + l2 * c.v, color, span + 4 * count);
+                ++count;
+            }
+            if (count != 0)
+                simd::blend(target.pixels + y * target.stride + 4 * static_cast<std::size_t>(first), 0, span, 0, count, 1, blend);
+        }
+    }
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned width, unsigned height)
+: mView(sf::FloatRect(0.f, 0.f, static_cast<float>(width), static_cast<float>(height)))
+{
+    setSize(width, height);
+}
+
+void SoftwareRenderer::clear()
+{
+    mEntries.clear();
+    mImages.clear();
+    mBatches.clear();
+}
+
+void SoftwareRenderer::setThreadPool(ThreadPool* pool)
+{
+    mThreadPool = pool;
+}
+
+void SoftwareRenderer::setSize(unsigned width, unsigned height)
+{
+    mWidth = width;
+    mHeight = height;
+    mPixels.assign(static_cast<std::size_t>(width) * height * 4, 0);
+    setTileSize(mTileSize);
+}
+
+sf::Vector2u SoftwareRenderer::getSize() const
+{
+    return {mWidth, mHeight};
+}
+
+void SoftwareRenderer::setView(sf::View const& view)
+{
+    mView = view;
+}
+
+const sf::View& SoftwareRenderer::getView() const
+{
+    return mView;
+}
+
+//at least 8 pixels, so that tile coordinates always fit in 16 bits
+void SoftwareRenderer::setTileSize(unsigned size)
+{
+    mTileSize = std::max(size, 8u);
+    mTilesX = (mWidth + mTileSize - 1) / mTileSize;
+    mTilesY = (mHeight + mTileSize - 1) / mTileSize;
+}
+
+const std::uint8_t* SoftwareRenderer::getPixels() const
+{
+    return mPixels.data();
+}
+
+sf::Image SoftwareRenderer::copyToImage() const
+{
+    sf::Image image;
+    image.create(mWidth, mHeight, mPixels.data());
+    return image;
+}
+
+void SoftwareRenderer::resolve()
+{
+    //the viewport in pixels, rounded like sf::RenderTarget::getViewport() does
+    const sf::FloatRect viewport = mView.getViewport();
+    const float width = static_cast<float>(mWidth), height = static_cast<float>(mHeight);
+    mClip = sf::IntRect(static_cast<int>(0.5f + width * viewport.left), static_cast<int>(0.5f + height * viewport.top),
+                        static_cast<int>(0.5f + width * viewport.width), static_cast<int>(0.5f + height * viewport.height));
+    //from the view's [-1, 1] square into the viewport, y pointing down
+    const float halfWidth = static_cast<float>(mClip.width) / 2.f, halfHeight = static_cast<float>(mClip.height) / 2.f;
+    const sf::Transform toPixels(halfWidth, 0.f, static_cast<float>(mClip.left) + halfWidth,
+                                 0.f, -halfHeight, static_cast<float>(mClip.top) + halfHeight,
+                                 0.f, 0.f, 1.f);
+    const sf::Transform view = toPixels * mView.getTransform();
+    const sf::FloatRect world = mView.getInverseTransform().transformRect({-1.f, -1.f, 2.f, 2.f});
+
+    for (Entry const& entry : mEntries)
+    {
+        if (!entry.texture || entry.image)
+            continue;
+        const bool known = std::any_of(mImages.begin(), mImages.end(), [&entry](auto const& image) { return image.first == entry.texture; });
+        if (!known)
+            mImages.emplace_back(entry.texture, entry.texture->copyToImage());
+    }
+
+    mBatches.clear();
+    std::size_t quads = 0;
+    for (Entry const& entry : mEntries)
+    {
+        entry.cull(entry.transform.getInverse().transformRect(world));
+        const sf::VertexArray& vertices = entry.vertices();
+        Batch batch = {};
+        batch.vertices = vertices.getVertexCount() != 0 ? &vertices[0] : nullptr;
+        batch.firstQuad = quads;
+        const sf::Transform transform = view * entry.transform;
+        const float* matrix = transform.getMatrix();
+        const float affine[6] = {matrix[0], matrix[4], matrix[12], matrix[1], matrix[5], matrix[13]};
+        std::copy(affine, affine + 6, batch.matrix);
+        const sf::Image* image = entry.image;
+        for (auto const& copy : mImages)
+            if (!image && copy.first == entry.texture)
+                image = &copy.second;
+        if (entry.texture && image && image->getSize().x != 0 && image->getSize().y != 0)
+        {
+            batch.texels = image->getPixelsPtr();
+            batch.textureWidth = static_cast<int>(image->getSize().x);
+            batch.textureHeight = static_cast<int>(image->getSize().y);
+            batch.smooth = entry.texture->isSmooth();
+        }
+        batch.blend = makeBlendFunction(entry.blendMode());
+        mBatches.push_back(batch);
+        quads += vertices.getVertexCount() / 4;
+    }
+    //ends the last batch, so that finding a quad's batch needs no bounds check
+    Batch end = {};
+    end.firstQuad = quads;
+    mBatches.push_back(end);
+}
+
+void SoftwareRenderer::render(sf::Color background)
+{
+    resolve();
+    const std::size_t quads = mBatches.back().firstQuad;
+    const std::size_t tiles = static_cast<std::size_t>(mTilesX) * mTilesY;
+    const std::size_t chunks = (quads + kSetupChunk - 1) / kSetupChunk;
+    mQuads.resize(quads);
+    mRanges.resize(quads);
+    mCounts.assign(chunks * tiles, 0);
+
+    //every quad in pixels and the tiles it touches, counted per chunk so that chunks can also be binned in parallel and in order
+    const float clipLeft = static_cast<float>(mClip.left), clipRight = static_cast<float>(mClip.left + mClip.width - 1);
+    const float clipTop = static_cast<float>(mClip.top), clipBottom = static_cast<float>(mClip.top + mClip.height - 1);
+    //named and passed by reference, as its captures are too many for std::function to hold without allocating
+    const auto setup = [this, tiles, clipLeft, clipRight, clipTop, clipBottom](std::size_t begin, std::size_t end)
+    {
+        std::size_t* counts = mCounts.data() + begin / kSetupChunk * tiles;
+        std::size_t batch = 0;
+        while (begin >= mBatches[batch + 1].firstQuad)
+            ++batch;
+        for (std::size_t quad = begin; quad < end; ++quad)
+        {
+            while (quad >= mBatches[batch + 1].firstQuad)
+                ++batch;
+            Batch const& owner = mBatches[batch];
+            const sf::Vertex* vertex = owner.vertices + 4 * (quad - owner.firstQuad);
+            const float* m = owner.matrix;
+            float x[4], y[4];
+            float left = std::numeric_limits<float>::max(), right = -left, top = left, bottom = -left, sum = 0.f;
+            for (int i = 0; i < 4; ++i)
+            {
+                const sf::Vector2f p = vertex[i].position;
+                x[i] = m[0] * p.x + m[1] * p.y + m[2];
+                y[i] = m[3] * p.x + m[4] * p.y + m[5];
+                left = std::min(left, x[i]);
+                right = std::max(right, x[i]);
+                top = std::min(top, y[i]);
+                bottom = std::max(bottom, y[i]);
+                sum += x[i] + y[i];
+            }
+            Quad& record = mQuads[quad];
+            record.x0 = x[0];
+            record.x1 = x[1];
+            record.y0 = y[0];
+            record.y1 = y[3];
+            record.u0 = vertex[0].texCoords.x;
+            record.u1 = vertex[1].texCoords.x;
+            record.v0 = vertex[0].texCoords.y;
+            record.v1 = vertex[3].texCoords.y;
+            record.color = vertex[0].color;
+            record.batch = static_cast<std::uint32_t>(batch);
+            record.index = static_cast<std::uint32_t>(quad);
+            record.aligned = isAxisAligned(vertex, x, y);
+            //pixel centers inside, clamped to the viewport before converting to int
+            left = std::max(clipLeft, std::ceil(left - 0.5f));
+            right = std::min(clipRight, std::floor(right - 0.5f));
+            top = std::max(clipTop, std::ceil(top - 0.5f));
+            bottom = std::min(clipBottom, std::floor(bottom - 0.5f));
+            TileRange& range = mRanges[quad];
+            if (!std::isfinite(sum) || left > right || top > bottom)
+            {
+                range = {1, 0, 0, 0};
+                continue;
+            }
+            range.left = static_cast<std::uint16_t>(static_cast<unsigned>(left) / mTileSize);
+            range.right = static_cast<std::uint16_t>(static_cast<unsigned>(right) / mTileSize);
+            range.top = static_cast<std::uint16_t>(static_cast<unsigned>(top) / mTileSize);
+            range.bottom = static_cast<std::uint16_t>(static_cast<unsigned>(bottom) / mTileSize);
+            for (unsigned y = range.top; y <= range.bottom; ++y)
+                for (unsigned x = range.left; x <= range.right; ++x)
+                    ++counts[y * mTilesX + x];
+        }
+    };
+    ThreadPool::run(mThreadPool, quads, kSetupChunk, std::cref(setup));
+
+    //every tile's bin holds its quads chunk after chunk, so in the order they were added
+    mBinStart.assign(tiles + 1, 0);
+    std::size_t offset = 0;
+    for (std::size_t tile = 0; tile < tiles; ++tile)
+    {
+        mBinStart[tile] = offset;
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            std::size_t& count = mCounts[chunk * tiles + tile];
+            const std::size_t quadsInTile = count;
+            count = offset;
+            offset += quadsInTile;
+        }
+    }
+    mBinStart[tiles] = offset;
+    mBinned.resize(offset);
+
+    ThreadPool::run(mThreadPool, quads, kSetupChunk, [this, tiles](std::size_t begin, std::size_t end)
+    {
+        std::size_t* cursors = mCounts.data() + begin / kSetupChunk * tiles;
+        for (std::size_t quad = begin; quad < end; ++quad)
+        {
+            TileRange const& range = mRanges[quad];
+            for (unsigned y = range.top; y <= range.bottom; ++y)
+                for (unsigned x = range.left; x <= range.right; ++x)
+                    mBinned[cursors[y * mTilesX + x]++] = mQuads[quad];
+        }
+    });
+
+    ThreadPool::run(mThreadPool, tiles, 1, [this, background](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t tile = begin; tile < end; ++tile)
+            drawTile(tile, background);
+    });
+}
+
+void SoftwareRenderer::drawTile(std::size_t tile, sf::Color background)
+{
+    const int left = static_cast<int>(tile % mTilesX * mTileSize);
+    const int top = static_cast<int>(tile / mTilesX * mTileSize);
+    const int right = std::min(static_cast<int>(mWidth), left + static_cast<int>(mTileSize));
+    const int bottom = std::min(static_cast<int>(mHeight), top + static_cast<int>(mTileSize));
+    const std::size_t stride = static_cast<std::size_t>(mWidth) * 4;
+    const std::uint8_t color[4] = {background.r, background.g, background.b, background.a};
+    for (int y = top; y < bottom; ++y)
+    {
+        std::uint8_t* row = mPixels.data() + y * stride;
+        for (int x = left; x < right; ++x)
+            std::copy(color, color + 4, row + 4 * x);
+    }
+
+    Target target;
+    target.pixels = mPixels.data();
+    target.stride = stride;
+    target.left = std::max(left, mClip.left);
+    target.top = std::max(top, mClip.top);
+    target.right = std::min(right, mClip.left + mClip.width);
+    target.bottom = std::min(bottom, mClip.top + mClip.height);
+    if (target.left >= target.right || target.top >= target.bottom)
+        return;
+
+    //room for a whole tile of source colors
+    thread_local std::vector<float> span;
+    span.resize(4 * static_cast<std::size_t>(mTileSize) * mTileSize);
+    const float scale = 1.f / 255.f;
+    for (std::size_t k = mBinStart[tile]; k < mBinStart[tile + 1]; ++k)
+    {
+        Quad const& quad = mBinned[k];
+        Batch const& owner = mBatches[quad.batch];
+        const Source source = {owner.texels, owner.textureWidth, owner.textureHeight, owner.smooth};
+        if (quad.aligned)
+        {
+            const sf::Color c = quad.color;
+            const Rect rect = {quad.x0, quad.x1, quad.y0, quad.y1, quad.u0, quad.u1, quad.v0, quad.v1,
+                               {c.r * scale, c.g * scale, c.b * scale, c.a * scale}};
+            drawRect(target, source, owner.blend, rect, span.data());
+            continue;
+        }
+        const sf::Vertex* vertex = owner.vertices + 4 * (quad.index - owner.firstQuad);
+        const float* m = owner.matrix;
+        Corner corners[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            const sf::Vector2f p = vertex[i].position;
+            const sf::Color c = vertex[i].color;
+            corners[i] = {m[0] * p.x + m[1] * p.y + m[2], m[3] * p.x + m[4] * p.y + m[5], vertex[i].texCoords.x, vertex[i].texCoords.y,
+                          {c.r * scale, c.g * scale, c.b * scale, c.a * scale}};
+        }
+        drawTriangle(target, source, owner.blend, corners[0], corners[1], corners[2], span.data());
+        drawTriangle(target, source, owner.blend, corners[0], corners[2], corners[3], span.data());
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef SOFTWARERENDERER_HPP
+#define SOFTWARERENDERER_HPP
+
+#include "ParticleSystem.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+#include <SFML/Graphics/BlendMode.hpp>
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/Graphics/Transform.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/Graphics/View.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Draws ParticleSystems on the CPU into an RGBA framebuffer, for machines without a GPU or an OpenGL context,
+// e.g. to render thumbnails and previews on a server.
+// The quads of every added system (getVertices(), culled against the view) are binned into square tiles of the
+// framebuffer, then every tile is drawn on its own, in parallel with a ThreadPool. Within a tile quads are drawn
+// in the order they were added, so the result is that of drawing the systems one after another, whatever the
+// thread count.
+// It follows what OpenGL does for a draw(): a quad is two triangles that cover the pixels whose centers lie
+// inside them, the texture is sampled nearest (bilinear if it is smooth) and clamped at its edges, texels are
+// multiplied by the vertex color, and the blend mode is applied per pixel and rounded to 8 bits per channel
+// (simd::blend). Quads without rotation and of one color, which is what most particles make, take a faster path.
+class SoftwareRenderer
+{
+public:
+    SoftwareRenderer(unsigned width, unsigned height);
+public:
+    //transform is what would be in the sf::RenderStates of a draw()
+    template <typename ParticleType, typename Storage>
+    void add(ParticleSystem<ParticleType, Storage>& system, sf::Transform const& transform = sf::Transform::Identity);
+    //image holds the pixels of the system's texture and has to outlive the renderer; without it, they are read back
+    //from the texture once with copyToImage(), which needs an OpenGL context
+    template <typename ParticleType, typename Storage>
+    void add(ParticleSystem<ParticleType, Storage>& system, sf::Image const& image, sf::Transform const& transform = sf::Transform::Identity);
+    void clear();
+
+    void setThreadPool(ThreadPool* pool);
+    //resizes the framebuffer; the view is left as it is
+    void setSize(unsigned width, unsigned height);
+    sf::Vector2u getSize() const;
+    //defaults to the whole framebuffer, in pixels
+    void setView(sf::View const& view);
+    const sf::View& getView() const;
+    //side of a tile in pixels
+    void setTileSize(unsigned size);
+
+    //clears the framebuffer to background and draws every added system into it
+    void render(sf::Color background = sf::Color::Transparent);
+    //width * height RGBA pixels, row by row from the top
+    const std::uint8_t* getPixels() const;
+    sf::Image copyToImage() const;
+private:
+    struct Entry
+    {
+        const sf::Texture* texture;
+        const sf::Image* image;
+        sf::Transform transform;
+        std::function<const sf::VertexArray&()> vertices;
+        std::function<void(sf::FloatRect)> cull;
+        std::function<sf::BlendMode()> blendMode;
+    };
+    //an entry as one render() sees it
+    struct Batch
+    {
+        const sf::Vertex* vertices;
+        std::size_t firstQuad;      //among the quads of all entries
+        float matrix[6];            //x' = m0 x + m1 y + m2, y' = m3 x + m4 y + m5, in framebuffer pixels
+        const std::uint8_t* texels; //null for untextured systems
+        int textureWidth;
+        int textureHeight;
+        bool smooth;
+        simd::BlendFunction blend;
+    };
+    //a quad as the tiles read it, copied into the bin of every tile it touches so that tiles read their bins in order
+    struct Quad
+    {
+        float x0, x1, y0, y1;       //left and right, top and bottom edges of an axis-aligned quad of one color, in pixels
+        float u0, u1, v0, v1;       //texture coordinates along them
+        sf::Color color;
+        std::uint32_t batch;
+        std::uint32_t index;        //among all quads; other quads are drawn from their vertices
+        bool aligned;
+    };
+    //the tiles a quad touches (inclusive)
+    struct TileRange
+    {
+        std::uint16_t left, top, right, bottom;
+    };
+private:
+    void resolve();
+    void drawTile(std::size_t tile, sf::Color background);
+private:
+    static constexpr std::size_t kSetupChunk = 4096;
+    std::vector<Entry> mEntries;
+    std::vector<std::pair<const sf::Texture*, sf::Image>> mImages;  //read back from textures
+    std::vector<Batch> mBatches;
+    ThreadPool* mThreadPool = nullptr;
+    unsigned mWidth;
+    unsigned mHeight;
+    sf::View mView;
+    sf::IntRect mClip;              //the view's viewport in pixels, nothing is drawn outside
+    unsigned mTileSize = 64;
+    unsigned mTilesX = 0;
+    unsigned mTilesY = 0;
+    std::vector<std::uint8_t> mPixels;
+    std::vector<Quad> mQuads;
+    std::vector<TileRange> mRanges;
+    std::vector<std::size_t> mCounts;           //quads per setup chunk and tile, then where the chunk writes them
+    std::vector<std::size_t> mBinStart;         //first entry of every tile in mBinned, plus the end
+    std::vector<Quad> mBinned;                  //tile by tile
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename ParticleType, typename Storage>
+void SoftwareRenderer::add(ParticleSystem<ParticleType, Storage>& system, sf::Transform const& transform)
+{
+    Entry entry;
+    entry.texture = system.getTexture();
+    entry.image = nullptr;
+    entry.transform = transform;
+    entry.vertices = [&system]() -> const sf::VertexArray& { return system.getVertices(); };
+    entry.cull = [&system](sf::FloatRect rect) { system.setCullRect(rect); };
+    entry.blendMode = [&system]() { return system.getBlendMode(); };
+    mEntries.push_back(entry);
+}
+
+template <typename ParticleType, typename Storage>
+void SoftwareRenderer::add(ParticleSystem<ParticleType, Storage>& system, sf::Image const& image, sf::Transform const& transform)
+{
+    add(system, transform);
+    mEntries.back().image = &image;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "SpatialGrid.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace
+{
+    const sf::Vector2f& positionAt(const sf::Vector2f* base, std::size_t stride, std::size_t index)
+    {
+        return *reinterpret_cast<const sf::Vector2f*>(reinterpret_cast<const char*>(base) + index * stride);
+    }
+}
+
+void SpatialGrid::build(const sf::Vector2f* base, std::size_t count, std::size_t stride, float cellSize,
+                        ThreadPool* pool, std::size_t chunkSize)
+{
+    clear();
+    if (count == 0)
+        return;
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+
+    //bounding box, one partial box per chunk so the reduction doesn't depend on the thread count
+    const std::size_t chunks = (count + chunkSize - 1) / chunkSize;
+    mLow.resize(chunks);
+    mHigh.resize(chunks);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        sf::Vector2f lo = positionAt(base, stride, begin), hi = lo;
+        for (std::size_t i = begin + 1; i < end; ++i)
+        {
+            const sf::Vector2f& p = positionAt(base, stride, i);
+            lo.x = std::min(lo.x, p.x);
+            lo.y = std::min(lo.y, p.y);
+            hi.x = std::max(hi.x, p.x);
+            hi.y = std::max(hi.y, p.y);
+        }
+        mLow[begin / chunkSize] = lo;
+        mHigh[begin / chunkSize] = hi;
+    });
+    sf::Vector2f lo = mLow[0], hi = mHigh[0];
+    for (std::size_t c = 1; c < chunks; ++c)
+    {
+        lo.x = std::min(lo.x, mLow[c].x);
+        lo.y = std::min(lo.y, mLow[c].y);
+        hi.x = std::max(hi.x, mHigh[c].x);
+        hi.y = std::max(hi.y, mHigh[c].y);
+    }
+
+    mCellSize = std::max(cellSize, std::numeric_limits<float>::min());
+    mInverseCellSize = 1.f / mCellSize;
+    mOrigin = lo;
+    //capped so a tiny cell size over a huge box can't overflow the cell coordinates
+    const double maxCells = 1u << 30;
+    mColumns = static_cast<std::size_t>(std::min(static_cast<double>(hi.x - lo.x) * mInverseCellSize, maxCells)) + 1;
+    mRows = static_cast<std::size_t>(std::min(static_cast<double>(hi.y - lo.y) * mInverseCellSize, maxCells)) + 1;
+    //a dense grid as long as it needs no more than a few cells per particle
+    std::size_t cells = mColumns * mRows;
+    mBucketMask = 0;
+    if (static_cast<double>(mColumns) * static_cast<double>(mRows) > static_cast<double>(4 * count + 64))
+    {
+        cells = 64;
+        while (cells < 2 * count)
+            cells *= 2;
+        mBucketMask = cells - 1;
+    }
+
+    //count
+    mCell.resize(count);
+    while (mCounts.size() < cells + 1)
+        mCounts.emplace_back(0);
+    for (std::size_t c = 0; c <= cells; ++c)
+        mCounts[c].store(0, std::memory_order_relaxed);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const std::size_t cell = cellOf(positionAt(base, stride, i));
+            mCell[i] = static_cast<std::uint32_t>(cell);
+            mCounts[cell].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    //prefix sum; mCellStart[c] doubles as the scatter cursor of cell c
+    mCellStart.resize(cells + 1);
+    std::uint32_t total = 0;
+    for (std::size_t c = 0; c <= cells; ++c)
+    {
+        const std::uint32_t n = mCounts[c].load(std::memory_order_relaxed);
+        mCounts[c].store(total, std::memory_order_relaxed);
+        mCellStart[c] = total;
+        total += n;
+    }
+
+    //scatter
+    mIndices.resize(count);
+    ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            mIndices[mCounts[mCell[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<std::uint32_t>(i);
+    });
+
+    //threads may have scattered a cell out of order; sorting each cell keeps the result deterministic
+    mPositions.resize(count);
+    ThreadPool::run(pool, cells, std::max<std::size_t>(chunkSize / 4, 1), [&](std::size_t begin, std::size_t end)
+    {
+        if (pool)
+        {
+            for (std::size_t c = begin; c < end; ++c)
+                std::sort(mIndices.begin() + mCellStart[c], mIndices.begin() + mCellStart[c + 1]);
+        }
+        for (std::size_t i = mCellStart[begin]; i < mCellStart[end]; ++i)
+            mPositions[i] = positionAt(base, stride, mIndices[i]);
+    });
+}
+
+void SpatialGrid::renumber(const std::uint32_t* newIndex, ThreadPool* pool, std::size_t chunkSize)
+{
+    const std::size_t cells = mCellStart.empty() ? 0 : mCellStart.size() - 1;
+    ThreadPool::run(pool, cells, std::max<std::size_t>(chunkSize / 4, 1), [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = mCellStart[begin]; i < mCellStart[end]; ++i)
+            mIndices[i] = newIndex[mIndices[i]];
+        //back in index order, positions along
+        for (std::size_t c = begin; c < end; ++c)
+        {
+            for (std::size_t i = mCellStart[c] + 1; i < mCellStart[c + 1]; ++i)
+            {
+                const std::uint32_t index = mIndices[i];
+                const sf::Vector2f position = mPositions[i];
+                std::size_t j = i;
+                for (; j > mCellStart[c] && mIndices[j - 1] > index; --j)
+                {
+                    mIndices[j] = mIndices[j - 1];
+                    mPositions[j] = mPositions[j - 1];
+                }
+                mIndices[j] = index;
+                mPositions[j] = position;
+            }
+        }
+    });
+}
+
+void SpatialGrid::clear()
+{
+    mColumns = 0;
+    mRows = 0;
+    mBucketMask = 0;
+    mCellStart.clear();
+    mIndices.clear();
+    mPositions.clear();
+    mCell.clear();
+}
+
+std::size_t SpatialGrid::query(sf::Vector2f point, float radius, std::vector<std::uint32_t>& out) const
+{
+    const std::size_t before = out.size();
+    forEachNeighbor(point, radius, [&out](std::size_t index, sf::Vector2f)
+    {
+        out.push_back(static_cast<std::uint32_t>(index));
+    });
+    return out.size() - before;
+}
+
+std::size_t SpatialGrid::size() const
+{
+    return mIndices.size();
+}
+
+bool SpatialGrid::empty() const
+{
+    return mIndices.empty();
+}
+
+float SpatialGrid::getCellSize() const
+{
+    return mCellSize;
+}
+
+std::size_t SpatialGrid::getCellCount() const
+{
+    return mBucketMask ? mBucketMask + 1 : mColumns * mRows;
+}
+
+bool SpatialGrid::isHashed() const
+{
+    return mBucketMask != 0;
+}
+
+std::size_t SpatialGrid::bytes() const
+{
+    return (mCellStart.capacity() + mIndices.capacity() + mCell.capacity()) * sizeof(std::uint32_t)
+         + (mPositions.capacity() + mLow.capacity() + mHigh.capacity()) * sizeof(sf::Vector2f)
+         + mCounts.size() * sizeof(std::atomic<std::uint32_t>);
+}
+
+std::size_t SpatialGrid::cellOf(sf::Vector2f position) const
+{
+    if (mBucketMask)
+        return bucketOf(column(position.x), row(position.y));
+    return row(position.y) * mColumns + column(position.x);
+}
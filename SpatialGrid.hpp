@@ -0,0 +1,135 @@
+#ifndef SPATIALGRID_HPP
+#define SPATIALGRID_HPP
+
+#include <SFML/System/Vector2.hpp>
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Uniform grid over a snapshot of particle positions, for neighbour queries.
+// build() bins every position into a square cell with a counting sort: count per cell, prefix sum,
+// scatter. The particles of one cell end up next to each other, in index order, together with a copy
+// of their positions, so a query only walks the few cells its circle overlaps.
+// The grid covers the bounding box of the positions. When that box would need far more cells than
+// there are particles (a few stragglers far away), the cells are hashed into a table about twice the
+// particle count instead, so memory stays linear; queries then check that a particle really sits in
+// the cell they are visiting, since unrelated cells can share a bucket.
+// Positions have to be finite.
+class SpatialGrid
+{
+public:
+    //positions are read from base, base + stride bytes, base + 2 * stride bytes, ...
+    //so the position member of an array of particles can be indexed in place.
+    //With a pool, every pass but the prefix sum runs chunk by chunk on it.
+    void build(const sf::Vector2f* base, std::size_t count, std::size_t stride, float cellSize,
+               ThreadPool* pool = nullptr, std::size_t chunkSize = 4096);
+    void clear();
+    //after the particles were reordered: particle i is particle newIndex[i] from now on
+    void renumber(const std::uint32_t* newIndex, ThreadPool* pool = nullptr, std::size_t chunkSize = 4096);
+
+    //calls function(index, position) for every particle within radius of point, itself included
+    template <typename Function>
+    void forEachNeighbor(sf::Vector2f point, float radius, Function&& function) const;
+    //appends the indices of every particle within radius of point to out, returns how many were found
+    std::size_t query(sf::Vector2f point, float radius, std::vector<std::uint32_t>& out) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    float getCellSize() const;
+    //cells, or hash buckets when the grid is hashed
+
+    std::size_t getCellCount() const;
+    std::size_t bytes() const;
+    bool isHashed() const;
+private:
+    std::size_t cellOf(sf::Vector2f position) const;
+    std::size_t bucketOf(std::size_t x, std::size_t y) const;
+    std::size_t column(float x) const;
+    std::size_t row(float y) const;
+private:
+    sf::Vector2f mOrigin;
+    float mCellSize = 1.f;
+    float mInverseCellSize = 1.f;
+    std::size_t mColumns = 0;
+    std::size_t mRows = 0;
+    std::size_t mBucketMask = 0;             //table size - 1 when hashed, 0 for a dense grid
+    std::vector<std::uint32_t> mCellStart;   //mCellStart[c] .. mCellStart[c + 1] are the particles of cell c
+    std::vector<std::uint32_t> mIndices;     //particle indices, sorted by cell
+    std::vector<sf::Vector2f> mPositions;    //their positions, in the same order
+    std::vector<std::uint32_t> mCell;        //cell of every particle, by particle index
+    //scratch of build(), kept so that rebuilding every frame doesn't allocate
+    std::vector<sf::Vector2f> mLow;          //bounding box of every chunk
+    std::vector<sf::Vector2f> mHigh;
+    std::deque<std::atomic<std::uint32_t>> mCounts;   //per cell; a deque because atomics can't be moved
+};
+
+// INLINE DEFINITIONS
+
+template <typename Function>
+void SpatialGrid::forEachNeighbor(sf::Vector2f point, float radius, Function&& function) const
+{
+    if (mIndices.empty())
+        return;
+    //cells overlapping the square around the circle, clamped to the grid
+    const std::size_t x0 = column(point.x - radius);
+    const std::size_t x1 = column(point.x + radius);
+    const std::size_t y0 = row(point.y - radius);
+    const std::size_t y1 = row(point.y + radius);
+    const float radius2 = radius * radius;
+
+    for (std::size_t y = y0; y <= y1; ++y)
+    {
+        if (mBucketMask)
+        {
+            for (std::size_t x = x0; x <= x1; ++x)
+            {
+                const std::size_t bucket = bucketOf(x, y);
+                for (std::size_t i = mCellStart[bucket]; i < mCellStart[bucket + 1]; ++i)
+                {
+                    const sf::Vector2f d = mPositions[i] - point;
+                    if (d.x * d.x + d.y * d.y <= radius2 && column(mPositions[i].x) == x && row(mPositions[i].y) == y)
+                        function(static_cast<std::size_t>(mIndices[i]), mPositions[i]);
+                }
+            }
+            continue;
+        }
+        //the cells of one row are contiguous, and so are their particles
+        const std::size_t first = mCellStart[y * mColumns + x0];
+        const std::size_t last = mCellStart[y * mColumns + x1 + 1];
+        for (std::size_t i = first; i < last; ++i)
+        {
+            const sf::Vector2f d = mPositions[i] - point;
+            if (d.x * d.x + d.y * d.y <= radius2)
+                function(static_cast<std::size_t>(mIndices[i]), mPositions[i]);
+        }
+    }
+}
+
+inline std::size_t SpatialGrid::column(float x) const
+{
+    const float cell = (x - mOrigin.x) * mInverseCellSize;
+    if (!(cell > 0.f))
+        return 0;
+    return cell < static_cast<float>(mColumns) ? static_cast<std::size_t>(cell) : mColumns - 1;
+}
+
+inline std::size_t SpatialGrid::row(float y) const
+{
+    const float cell = (y - mOrigin.y) * mInverseCellSize;
+    if (!(cell > 0.f))
+        return 0;
+    return cell < static_cast<float>(mRows) ? static_cast<std::size_t>(cell) : mRows - 1;
+}
+
+inline std::size_t SpatialGrid::bucketOf(std::size_t x, std::size_t y) const
+{
+    return ((x * 73856093u) ^ (y * 19349663u)) & mBucketMask;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <SFML/System/Time.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Per-phase instrumentation for ParticleSystem and Emitter.
+// Define SMARTICLES_NO_STATS to compile every measurement out; the stats structs then stay at zero.
+namespace stats
+{
+#ifdef SMARTICLES_NO_STATS
+    inline constexpr bool enabled = false;
+#else
+    inline constexpr bool enabled = true;
+#endif
+
+    //nanoseconds on the steady clock, or 0 when stats are compiled out
+    inline std::int64_t now()
+    {
+        if constexpr (enabled)
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        else
+            return 0;
+    }
+
+    enum class Phase
+    {
+        Aging,
+        Affectors,
+        Sort,
+        Vertices,
+        Finalizers,
+        Draw,
+        Count
+    };
+
+    inline const char* phaseName(Phase phase)
+    {
+        static const char* names[] = {"aging", "affectors", "sort", "vertices", "finalizers", "draw"};
+        return names[static_cast<std::size_t>(phase)];
+    }
+
+    inline sf::Time toTime(std::int64_t nanoseconds)
+    {
+        return sf::microseconds(nanoseconds / 1000);
+    }
+
+    //adds the time since start to total; safe to call from several threads at once
+    inline void accumulate(std::atomic<std::int64_t>& total, std::int64_t start)
+    {
+        if constexpr (enabled)
+            total.fetch_add(now() - start, std::memory_order_relaxed);
+    }
+
+    // Rolling window of the last few frames of one phase, exported as log2-spaced microsecond buckets.
+    class Histogram
+    {
+    public:
+        explicit Histogram(std::size_t window = 0)
+        : mSamples()
+        , mWindow(window)
+        , mNext(0)
+        {
+
+        }
+
+        void add(sf::Time sample)
+        {
+            if (mWindow == 0)
+                return;
+            if (mSamples.size() < mWindow)
+                mSamples.push_back(sample);
+            else
+                mSamples[mNext] = sample;
+            mNext = (mNext + 1) % mWindow;
+        }
+
+        //p in [0, 1], e.g. 0.99 for the 99th percentile
+        sf::Time percentile(float p) const
+        {
+            if (mSamples.empty())
+                return sf::Time::Zero;
+            std::vector<sf::Time> sorted(mSamples);
+            const std::size_t rank = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+
+        //{"frames": n, "p50_us": .., "p99_us": .., "buckets_us": [1, 2, 4, ..], "counts": [..]}
+        //bucket i counts the frames that took less than buckets_us[i] but at least buckets_us[i - 1]
+        std::string toJson() const
+        {
+            std::vector<std::size_t> counts(kBuckets, 0);
+            for (sf::Time sample : mSamples)
+            {
+                std::size_t bucket = 0;
+                while (bucket + 1 < kBuckets && sample.asMicroseconds() >= (std::int64_t(1) << bucket))
+                    ++bucket;
+                ++counts[bucket];
+            }
+            std::ostringstream out;
+            out << "{\"frames\": " << mSamples.size() << ", \"p50_us\": " << percentile(0.5f).asMicroseconds()
+                << ", \"p99_us\": " << percentile(0.99f).asMicroseconds() << ", \"buckets_us\": [";
+            for (std::size_t i = 0; i < kBuckets; ++i)
+                out << (i ? ", " : "") << (std::int64_t(1) << i);
+            out << "], \"counts\": [";
+            for (std::size_t i = 0; i < kBuckets; ++i)
+                out << (i ? ", " : "") << counts[i];
+            out << "]}";
+            return out.str();
+        }
+
+    private:
+        static constexpr std::size_t kBuckets = 24; //up to ~8s
+        std::vector<sf::Time> mSamples;
+        std::size_t mWindow;
+        std::size_t mNext;
+    };
+}
+
+// Last frame's cost of each ParticleSystem phase, plus running counters.
+// Phases that run chunk by chunk on a ThreadPool report the time summed over all threads.
+struct ParticleStats
+{
+    sf::Time aging;                 //removing dead particles and aging the rest
+    sf::Time spatialIndex;          //rebuilding the spatial index, if enabled
+    sf::Time affectors;             //all affectors together
+    sf::Time sort;                  //sorting by sortKey, if the particles have one (wall-clock)
+    std::vector<sf::Time> affector; //each affector, in the order they were added
+    sf::Time vertices;              //computeVertices()
+    sf::Time finalizers;
+    sf::Time draw;                  //submitting the quads to the render target
+    std::size_t spawned = 0;        //particles added since the system was created
+    std::size_t killed = 0;         //particles that expired since the system was created
+    std::size_t peak = 0;           //highest particle count seen
+    std::size_t culled = 0;         //particles left out of the last vertices by culling
+    std::size_t dropped = 0;        //new particles turned away at capacity, since the system was created
+    std::size_t replaced = 0;       //particles evicted at capacity by ReplaceOldest, since the system was created
+    std::size_t thinned = 0;        //particles evicted at capacity by Thin, since the system was created
+    std::size_t bytes = 0;          //memory currently held for particles and vertices
+};
+
+struct EmitterStats
+{
+    sf::Time emission;              //last update(), modifiers included
+    std::size_t emitted = 0;        //particles emitted since the emitter was created
+};
+
+#endif
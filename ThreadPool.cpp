@@ -0,0 +1,144 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+: mQueues()
+, mThreads()
+, mQueuedJobs(0)
+, mStopping(false)
+{
+    //one queue per worker, plus one for jobs handed out while there are no workers at all
+    for (unsigned i = 0; i < std::max(threadCount, 1u); ++i)
+        mQueues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threadCount; ++i)
+        mThreads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStopping = true;
+    }
+    mWake.notify_all();
+    for (auto& thread : mThreads)
+        thread.join();
+}
+
+unsigned ThreadPool::defaultThreadCount()
+{
+    //the calling thread takes part as well
+    const unsigned cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+    return static_cast<unsigned>(mThreads.size());
+}
+
+void ThreadPool::run(ThreadPool* pool, std::size_t count, std::size_t chunkSize, Task const& task)
+{
+    if (pool)
+    {
+        pool->parallelFor(count, chunkSize, task);
+        return;
+    }
+    //like parallelFor(), a chunk size of 0 is taken as 1
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+    for (std::size_t begin = 0; begin < count; begin += chunkSize)
+        task(begin, std::min(begin + chunkSize, count));
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t chunkSize, Task const& task)
+{
+    if (count == 0)
+        return;
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+    const std::size_t chunks = (count + chunkSize - 1) / chunkSize;
+
+    if (mThreads.empty() || chunks == 1)
+    {
+        for (std::size_t begin = 0; begin < count; begin += chunkSize)
+            task(begin, std::min(begin + chunkSize, count));
+        return;
+    }
+
+    std::atomic<std::size_t> remaining(chunks);
+    const std::size_t queues = mQueues.size();
+    for (std::size_t q = 0; q < queues; ++q)
+    {
+        const std::size_t first = chunks * q / queues;
+        const std::size_t last = chunks * (q + 1) / queues;
+        std::lock_guard<std::mutex> lock(mQueues[q]->mutex);
+        for (std::size_t c = first; c < last; ++c)
+            mQueues[q]->jobs.push_back({&task, c * chunkSize, std::min((c + 1) * chunkSize, count), &remaining});
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQueuedJobs += chunks;
+    }
+    mWake.notify_all();
+
+    //help out until every chunk of this call has finished, which also makes nested calls safe
+    Job job;
+    while (remaining.load(std::memory_order_acquire) != 0)
+    {
+        if (popJob(0, job))
+            runJob(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool ThreadPool::popJob(unsigned index, Job& job)
+{
+    const std::size_t queues = mQueues.size();
+    {
+        Queue& own = *mQueues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues; ++i)
+    {
+        Queue& victim = *mQueues[(index + i) % queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runJob(Job const& job)
+{
+    mQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    (*job.task)(job.begin, job.end);
+    job.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    Job job;
+    while (true)
+    {
+        if (popJob(index, job))
+        {
+            runJob(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWake.wait(lock, [this] { return mStopping || mQueuedJobs.load() != 0; });
+        if (mStopping)
+            return;
+    }
+}
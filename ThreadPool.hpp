@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing pool for data-parallel loops.
+// parallelFor() cuts a range into fixed-size chunks and deals them out to the workers' queues in
+// contiguous runs; a worker that runs dry steals from the back of another worker's queue.
+// The calling thread works on chunks too while it waits, so a pool of N threads uses N + 1 cores,
+// and a pool of 0 threads simply runs every chunk on the caller.
+// Chunk boundaries only depend on the chunk size, never on the thread count.
+class ThreadPool
+{
+public:
+    using Task = std::function<void(std::size_t, std::size_t)>;
+public:
+    explicit ThreadPool(unsigned threadCount = defaultThreadCount());
+    ~ThreadPool();
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+public:
+    //calls task(begin, end) for every chunk of [0, count) and returns once all chunks are done
+    void parallelFor(std::size_t count, std::size_t chunkSize, Task const& task);
+    //pool->parallelFor() with a pool, otherwise the same chunks one after another on the caller
+    static void run(ThreadPool* pool, std::size_t count, std::size_t chunkSize, Task const& task);
+    unsigned getThreadCount() const;
+    static unsigned defaultThreadCount();
+private:
+    struct Job
+    {
+        Task const* task;
+        std::size_t begin;
+        std::size_t end;
+        std::atomic<std::size_t>* remaining;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+private:
+    void workerLoop(unsigned index);
+    bool popJob(unsigned index, Job& job);
+    void runJob(Job const& job);
+private:
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::atomic<std::size_t> mQueuedJobs;
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+    bool mStopping;
+};
+
+#endif
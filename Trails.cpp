@@ -0,0 +1,208 @@
+#include "Trails.hpp"
+
+#include <cmath>
+
+namespace
+{
+    //on the curve through p0, p1, p2, p3, between p1 (t = 0) and p2 (t = 1)
+    sf::Vector2f catmullRom(sf::Vector2f p0, sf::Vector2f p1, sf::Vector2f p2, sf::Vector2f p3, float t)
+    {
+        const float t2 = t * t, t3 = t2 * t;
+        return 0.5f * (2.f * p1 + (p2 - p0) * t + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2 + (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+    }
+}
+
+void Trails::setLength(std::size_t points)
+{
+    mLength = points;
+    mRecorded = 0;
+    mMoves.clear();
+    mPoints.assign(mLength * mStride, sf::Vector2f());
+    std::fill(mBorn.begin(), mBorn.end(), 0);
+}
+
+std::size_t Trails::getLength() const
+{
+    return mLength;
+}
+
+void Trails::resize(std::size_t count)
+{
+    if (!mMoves.empty())
+    {
+        for (std::size_t c = 0; c < mLength; ++c)
+        {
+            sf::Vector2f* column = mPoints.data() + c * mStride;
+            for (auto const& move : mMoves)
+                column[move.second] = column[move.first];
+        }
+        for (auto const& move : mMoves)
+            mBorn[move.second] = mBorn[move.first];
+        mMoves.clear();
+    }
+    grow(count);
+    for (std::size_t i = mCount; i < count; ++i)
+        mBorn[i] = mRecorded;
+    mCount = count;
+}
+
+void Trails::reserve(std::size_t count)
+{
+    grow(count);
+}
+
+void Trails::move(std::size_t from, std::size_t to)
+{
+    mMoves.emplace_back(static_cast<std::uint32_t>(from), static_cast<std::uint32_t>(to));
+}
+
+//like storage::reorder(), column by column
+void Trails::reorder(const std::uint32_t* order, const std::uint32_t* moved, std::size_t count, ThreadPool* pool, std::size_t chunkSize)
+{
+    chunkSize = std::max<std::size_t>(chunkSize, 1);
+    mScratch.resize(count);
+    mBornScratch.resize(count);
+    auto apply = [&](auto* column, auto& scratch)
+    {
+        ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t j = begin; j < end; ++j)
+                scratch[j] = column[order[moved[j]]];
+        });
+        ThreadPool::run(pool, count, chunkSize, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t j = begin; j < end; ++j)
+                column[moved[j]] = scratch[j];
+        });
+    };
+    for (std::size_t c = 0; c < mLength; ++c)
+        apply(mPoints.data() + c * mStride, mScratch);
+    apply(mBorn.data(), mBornScratch);
+}
+
+void Trails::record(const sf::Vector2f* base, std::size_t stride, ThreadPool* pool, std::size_t chunkSize)
+{
+    if (mLength == 0)
+        return;
+    sf::Vector2f* column = mPoints.data() + (mRecorded % mLength) * mStride;
+    if (stride == sizeof(sf::Vector2f))
+    {
+        std::copy(base, base + mCount, column);
+    }
+    else
+    {
+        ThreadPool::run(pool, mCount, std::max<std::size_t>(chunkSize, 1), [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+                column[i] = *reinterpret_cast<const sf::Vector2f*>(reinterpret_cast<const char*>(base) + i * stride);
+        });
+    }
+    ++mRecorded;
+}
+
+void Trails::clear()
+{
+    mMoves.clear();
+    std::fill(mBorn.begin(), mBorn.begin() + mCount, mRecorded);
+}
+
+std::size_t Trails::quadCount(std::size_t points, unsigned subdivisions)
+{
+    return points < 2 ? 0 : (points - 1) * (subdivisions + 1);
+}
+
+void Trails::writeRibbon(std::size_t index, sf::Vector2f position, sf::Color color, float width, unsigned subdivisions,
+                         sf::FloatRect const& texture, sf::Vertex* quads) const
+{
+    const std::size_t steps = subdivisions + 1;
+    const std::size_t total = quadCount(mLength, subdivisions);
+    const std::size_t points = getPointCount(index);
+    const std::size_t used = quadCount(points, subdivisions);
+
+    //the ribbon's points, interpolated on the spot between the recorded points around them; one buffer per thread
+    thread_local std::vector<sf::Vector2f> buffer;
+    std::vector<sf::Vector2f>& ribbon = buffer;
+    if (used)
+    {
+        const std::size_t newest = (mRecorded - 1) % mLength;
+        auto point = [this, index, newest](std::size_t age)
+        {
+            const std::size_t column = age <= newest ? newest - age : newest + mLength - age;
+            return mPoints[column * mStride + index];
+        };
+        ribbon.resize(used + 1);
+        sf::Vector2f p0 = point(0), p1 = p0, p2 = point(1);
+        for (std::size_t k = 0; k + 1 < points; ++k)
+        {
+            const sf::Vector2f p3 = k + 2 < points ? point(k + 2) : p2;
+            ribbon[k * steps] = p1;
+            for (std::size_t step = 1; step < steps; ++step)
+                ribbon[k * steps + step] = catmullRom(p0, p1, p2, p3, static_cast<float>(step) / static_cast<float>(steps));
+            p0 = p1;
+            p1 = p2;
+            p2 = p3;
+        }
+        ribbon[used] = p1;
+    }
+
+    const float u = texture.left + texture.width, v = texture.top + texture.height / 2.f;
+    const float fade = 1.f / static_cast<float>(total);
+    //both edges of the ribbon at point j, across the direction between its neighbours
+    auto edges = [&ribbon, used, fade, width, color, &texture, u, v](std::size_t j, sf::Vertex& left, sf::Vertex& right)
+    {
+        const sf::Vector2f direction = ribbon[std::min(j + 1, used)] - ribbon[j ? j - 1 : 0];
+        const float length2 = direction.x * direction.x + direction.y * direction.y;
+        const float remaining = 1.f - static_cast<float>(j) * fade;
+        const float half = length2 > 0.f ? width * 0.5f * remaining / std::sqrt(length2) : 0.f;
+        const sf::Vector2f normal(-direction.y * half, direction.x * half);
+        const sf::Color c(color.r, color.g, color.b, static_cast<std::uint8_t>(color.a * remaining));
+        left = sf::Vertex(ribbon[j] + normal, c, {texture.left, v});
+        right = sf::Vertex(ribbon[j] - normal, c, {u, v});
+    };
+
+    std::size_t q = 0;
+    if (used)
+    {
+        sf::Vertex left, right;
+        edges(0, left, right);
+        for (; q < used; ++q)
+        {
+            sf::Vertex* quad = quads + 4 * q;
+            quad[0] = left;
+            quad[3] = right;
+            edges(q + 1, quad[1], quad[2]);
+            left = quad[1];
+            right = quad[2];
+        }
+        position = ribbon[used];
+    }
+    //quads the particle has no points for yet
+    const sf::Vertex empty(position, sf::Color::Transparent, {texture.left, v});
+    std::fill(quads + 4 * q, quads + 4 * total, empty);
+}
+
+std::size_t Trails::size() const
+{
+    return mCount;
+}
+
+std::size_t Trails::bytes() const
+{
+    return (mPoints.capacity() + mScratch.capacity()) * sizeof(sf::Vector2f)
+         + (mBorn.capacity() + mBornScratch.capacity()) * sizeof(std::uint32_t)
+         + mMoves.capacity() * sizeof(mMoves[0]);
+}
+
+//columns are stride apart, so more room moves every column
+void Trails::grow(std::size_t count)
+{
+    if (count <= mStride)
+        return;
+    const std::size_t stride = std::max(count, mStride + mStride / 2);
+    std::vector<sf::Vector2f> points(mLength * stride);
+    for (std::size_t c = 0; c < mLength; ++c)
+        std::copy(mPoints.begin() + c * mStride, mPoints.begin() + c * mStride + mCount, points.begin() + c * stride);
+    mPoints.swap(points);
+    mBorn.resize(stride);
+    mStride = stride;
+}
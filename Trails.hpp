@@ -0,0 +1,88 @@
+#ifndef TRAILS_HPP
+#define TRAILS_HPP
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The last few positions of every particle of a system, what ParticleSystem::setTrail() draws ribbons through.
+// All of it is one array of getLength() columns with a point per particle each: column k holds point k of every
+// particle. The columns are a ring, record() overwrites the oldest one with the current positions, so a step is
+// one contiguous write whatever the length of the trails, and no point is ever shifted along.
+// Every particle carries the step it was added in, so it has as many points as steps it was around for (up to
+// getLength()); a slot taken over by a new particle needs nothing cleared.
+// Points are kept by particle index: whatever moves particles has to move their history through move() or
+// reorder(), and resize() to the particle count has to come before either of them and before record().
+class Trails
+{
+public:
+    //points per particle, the newest included; forgets all history
+    void setLength(std::size_t points);
+    std::size_t getLength() const;
+    //particles [size(), count) start without points, particles from count on are dropped;
+    //carries out the moves queued by move() first, a column at a time
+    void resize(std::size_t count);
+    void reserve(std::size_t count);
+    //particle to takes over the points of particle from, queued until the next resize()
+    void move(std::size_t from, std::size_t to);
+    //particle k takes over the points of particle order[k], for the count slots k listed in moved (see RadixSort::getMoved())
+    void reorder(const std::uint32_t* order, const std::uint32_t* moved, std::size_t count,
+                 ThreadPool* pool = nullptr, std::size_t chunkSize = 4096);
+    //positions are read from base, base + stride bytes, ... like in SpatialGrid::build() and become every particle's newest point
+    void record(const sf::Vector2f* base, std::size_t stride, ThreadPool* pool = nullptr, std::size_t chunkSize = 4096);
+    //forgets all history, particles keep their slots
+    void clear();
+
+    //quads writeRibbon() writes per particle
+    static std::size_t quadCount(std::size_t points, unsigned subdivisions);
+    //the ribbon through the points of particle index, newest first, as quadCount() quads: the first ones join
+    //its points, subdivisions more points interpolated (Catmull-Rom) between every two of them; it is width wide
+    //at the newest point, narrows to nothing towards the oldest point a full trail would have and fades out along.
+    //u runs across the ribbon over texture, v stays at its middle. Quads the particle has no points for yet are
+    //left empty at its last point, or at position without any.
+    void writeRibbon(std::size_t index, sf::Vector2f position, sf::Color color, float width, unsigned subdivisions,
+                     sf::FloatRect const& texture, sf::Vertex* quads) const;
+
+    std::size_t size() const;
+    //how many points particle index has, up to getLength()
+    std::size_t getPointCount(std::size_t index) const;
+    //point age of particle index, 0 being the newest
+    sf::Vector2f getPoint(std::size_t index, std::size_t age) const;
+    std::size_t bytes() const;
+private:
+    void grow(std::size_t count);
+private:
+    std::size_t mLength = 0;
+    std::size_t mCount = 0;
+    std::size_t mStride = 0;                  //particles every column has room for
+    std::uint32_t mRecorded = 0;              //record()s since setLength(); the newest column is (mRecorded - 1) % mLength
+    std::vector<sf::Vector2f> mPoints;        //mLength columns of mStride points
+    std::vector<std::uint32_t> mBorn;         //mRecorded when the particle was added
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> mMoves;
+    std::vector<sf::Vector2f> mScratch;       //for reorder()
+    std::vector<std::uint32_t> mBornScratch;
+};
+
+// INLINE DEFINITIONS
+
+inline std::size_t Trails::getPointCount(std::size_t index) const
+{
+    return std::min<std::size_t>(mLength, mRecorded - mBorn[index]);
+}
+
+inline sf::Vector2f Trails::getPoint(std::size_t index, std::size_t age) const
+{
+    const std::size_t column = (mRecorded - 1 - age) % mLength;
+    return mPoints[column * mStride + index];
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer single-consumer hand-off of the latest value.
+// The producer fills back(), then publish() swaps it with the spare slot; the consumer's acquire()
+// swaps the spare slot with its front() if something new was published. Neither side ever waits for
+// the other, and the consumer skips values it was too slow to see. Slots are reused, not reallocated,
+// so vectors inside T keep their capacity.
+template <typename T>
+class TripleBuffer
+{
+public:
+    //producer side
+    T& back();
+    void publish();
+
+    //consumer side: true if front() changed
+    bool acquire();
+    const T& front() const;
+    T& front();
+private:
+    //low two bits: index of the spare slot, kFresh: the spare slot holds a value the consumer hasn't seen
+    static constexpr std::uint8_t kFresh = 4;
+    std::array<T, 3> mSlots;
+    std::atomic<std::uint8_t> mSpare{1};
+    std::uint8_t mBack = 0;
+    std::uint8_t mFront = 2;
+};
+
+// TEMPLATE DEFINITIONS
+
+template <typename T>
+T& TripleBuffer<T>::back()
+{
+    return mSlots[mBack];
+}
+
+template <typename T>
+void TripleBuffer<T>::publish()
+{
+    const std::uint8_t previous = mSpare.exchange(static_cast<std::uint8_t>(mBack | kFresh), std::memory_order_acq_rel);
+    mBack = previous & 3;
+}
+
+template <typename T>
+bool TripleBuffer<T>::acquire()
+{
+    if (!(mSpare.load(std::memory_order_relaxed) & kFresh))
+        return false;
+    const std::uint8_t previous = mSpare.exchange(mFront, std::memory_order_acq_rel);
+    mFront = previous & 3;
+    return true;
+}
+
+template <typename T>
+const T& TripleBuffer<T>::front() const
+{
+    return mSlots[mFront];
+}
+
+template <typename T>
+T& TripleBuffer<T>::front()
+{
+    return mSlots[mFront];
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "Utility.hpp"
+#include "Simd.hpp"
 #include <cmath>
 
 
@@ -6,7 +7,11 @@
 
 sf::Vector2f rotate(sf::Vector2f vector, float angle)
 {
-    sf::Vector2f rot{std::cos(angle), std::sin(angle)};
-    return {vector.x * rot.x - vector.y * rot.y, vector.y * rot.x + vector.x * rot.y};
+    return rotate(vector, sf::Vector2f{std::cos(angle), std::sin(angle)});
+}
+
+void rotate(sf::Vector2f* positions, std::size_t count, sf::Vector2f center, float angle)
+{
+    simd::rotate(positions, count, center, angle);
 }
 
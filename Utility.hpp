@@ -2,36 +2,29 @@
 #define UTILITY_HPP
 
 #include <SFML/System/Vector2.hpp>
+#include "Random.hpp"
 #include <iterator>
 #include <type_traits>
-#include <random>
+#include <cstddef>
 
-namespace
-{
-auto makeRandomEngine()
+//uniform in [a, b] for integers and [a, b) for floating point, drawn from this thread's generator (see Random.hpp)
+template<typename Numeric = int>
+Numeric getRandom(Numeric a, Numeric b)
 {
-    return std::default_random_engine(std::random_device()());
+    return rng::local().range(a, b);
 }
 
-auto engine = makeRandomEngine();
 
-} // namespace
+sf::Vector2f rotate(sf::Vector2f vector, float angle);
 
-template<typename Numeric = int>
-Numeric getRandom(Numeric a, Numeric b)
+//rotation by a precomputed {cos(angle), sin(angle)}, for loops that rotate many vectors by the same angle
+inline sf::Vector2f rotate(sf::Vector2f vector, sf::Vector2f rotation)
 {
-    if constexpr(std::is_integral_v<Numeric>)
-    {
-        return std::uniform_int_distribution<Numeric>(a, b)(engine);
-    }
-    if constexpr(std::is_floating_point_v<Numeric>)
-    {
-        return std::uniform_real_distribution<Numeric>(a, b)(engine);
-    }
+    return {vector.x * rotation.x - vector.y * rotation.y, vector.y * rotation.x + vector.x * rotation.y};
 }
 
-
-sf::Vector2f rotate(sf::Vector2f vector, float angle);
+//rotates count positions about center, cos/sin are evaluated once and the loop is vectorized (see Simd.hpp)
+void rotate(sf::Vector2f* positions, std::size_t count, sf::Vector2f center, float angle);
 
 
 
@@ -42,6 +35,8 @@ void pairIterate(iter1 begin1, iter1 end1, iter2 begin2, iter2 end2, Function fu
         func(*begin1, *begin2);
 }
 
+//inserts count points evenly spaced between *(pos - 1) and *pos, returns the first of them; every call shifts
+//the rest of the container, so for particle trails use ParticleSystem::setTrail() (see Trails.hpp) instead
 template<typename Container, typename Iter = typename Container::iterator>
 Iter interpolate(Container& container, Iter pos, int count)
 {
@@ -0,0 +1,394 @@
+// Headless simulation benchmark.
+// Drives ParticleSystem and Emitter through a fixed set of scenarios without a window or a GL context
+// and reports nanoseconds per particle for aging, affectors, computeVertices() and emission.
+// Affectors are timed by the system itself (getStats().affectors), summed over all threads with --threads and
+// in whole microseconds per frame, so a cheap affector reads low at the smallest counts.
+//
+//   benchmark [--max N] [--frames N] [--threads N] [--scenario NAME] [--seed N]
+//             [--out benchmark.json] [--baseline baseline.json] [--tolerance 0.10]
+//
+// Particle counts go from 1k up to --max (10M by default) in steps of 10x.
+// With --baseline, every phase that got slower than the baseline by more than --tolerance is reported,
+// and the exit code is 1, so the benchmark can gate a build.
+// Random numbers come from a fixed seed (1 unless --seed says otherwise), so every run simulates the same particles.
+
+#include "ParticleSystem.hpp"
+#include "Emitter.hpp"
+#include "Utility.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct ColorAndRadiusLen
+    {
+        sf::Color color;
+        double radius;
+    };
+
+    using PGreen = BaseParticle<ColorAndRadiusLen>;
+    using System = ParticleSystem<PGreen>;
+
+    const sf::Vector2f center{640.f, 360.f};
+    const sf::Time timePerFrame = sf::seconds(1.f / 60);
+
+    struct Options
+    {
+        std::size_t maxParticles = 10000000;
+        std::size_t frames = 0; //0 picks a frame count per particle count
+        unsigned threads = 0;
+        std::string scenario;
+        std::uint64_t seed = 1;
+        std::string out = "benchmark.json";
+        std::string baseline;
+        double tolerance = 0.10;
+    };
+
+    struct Result
+    {
+        std::string scenario;
+        std::size_t particles;
+        double aging;
+        double affectors;
+        double vertices;
+        double emission;
+    };
+
+    struct Scenario
+    {
+        std::string name;
+        //fills the system with count particles
+        void (*populate)(System&, std::size_t count);
+        //adds the scenario's affectors
+        void (*affect)(System&);
+    };
+
+    double now()
+    {
+        using namespace std::chrono;
+        return duration<double, std::nano>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    PGreen defaultParticle()
+    {
+        PGreen particle;
+        particle.lifetime = sf::seconds(50);
+        particle.color = sf::Color::Green;
+        particle.radius = 0.0;
+        return particle;
+    }
+
+    void populateBand(System& system, std::size_t count, bool randomLifetime)
+    {
+        system.reserve(count);
+        Rng& rng = rng::local();
+        std::vector<sf::Vector2f> positions(count);
+        rng.fillBand(positions.data(), count, center, 200.f, 350.f);
+        PGreen particle = defaultParticle();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            particle.position = positions[i];
+            const float radius = rng.uniform(0.0001f, 0.000800f);
+            particle.radius = rng() & 1u ? -radius : radius;
+            //random lifetimes kill a few particles every frame, all over the container
+            particle.lifetime = randomLifetime ? sf::seconds(rng.uniform(0.5f, 50.f)) : sf::seconds(50);
+            system.addParticle(particle);
+        }
+    }
+
+    //the orbit affector from main.cpp
+    void orbit(System& system)
+    {
+        const PGreen defaultGreen = defaultParticle();
+        system.addAffector([defaultGreen](std::vector<PGreen> &particleList) {
+            static int rotation = 0;
+            rotation ++;
+            const int maxRotation = 120;
+
+            float speed = particleList.size();
+            speed /= 1000;
+            const float angle = 0.01f * (speed + 1);
+            const sf::Vector2f turn{std::cos(angle), std::sin(angle)};
+            for (auto &particle : particleList)
+            {
+                sf::Vector2f len = rotate(particle.position - center, turn);
+                float variance = particle.radius;
+                if(rotation > 30 && rotation < 90)
+                    variance = -variance;
+                particle.position = len + center;
+                particle.position += (particle.position * variance);
+
+                float ratio = particle.lifetime.asSeconds() / defaultGreen.lifetime.asSeconds();
+                if(ratio > 0.95f)
+                {
+                    particle.color = sf::Color::White;
+                    ratio = (ratio - 0.90) * 10;
+                    particle.color.a = static_cast<uint8_t>(255 * std::max(0.0f, ratio));
+                }
+                else
+                {
+                    particle.color = defaultGreen.color;
+                    particle.color.a = static_cast<uint8_t>(255 * std::max(0.0f, ratio));
+                }
+            }
+            rotation %= maxRotation;
+        });
+    }
+
+    //a cheap per-particle drift, so the cost is dominated by the system rather than the affector
+    void drift(System& system)
+    {
+        system.addAffector([](PGreen &particle) { particle.position.x += 0.5f; });
+    }
+
+    static_assert(stats::enabled, "the affector phase is read from ParticleSystem::getStats()");
+
+    const std::vector<Scenario> scenarios = {
+        {"orbit", [](System& s, std::size_t n) { populateBand(s, n, false); }, orbit},
+        {"uniform_lifetime", [](System& s, std::size_t n) { populateBand(s, n, false); }, drift},
+        {"random_lifetime", [](System& s, std::size_t n) { populateBand(s, n, true); }, drift},
+        {"burst", [](System& s, std::size_t n) { populateBand(s, n, true); }, orbit},
+    };
+
+    std::size_t framesFor(Options const& options, std::size_t count)
+    {
+        if (options.frames)
+            return options.frames;
+        //roughly 20M particle updates per measurement, but never fewer than 3 frames
+        return std::max<std::size_t>(3, 20000000 / count);
+    }
+
+    //ns per particle of emitting count particles into an empty system through an Emitter
+    double measureEmission(std::size_t count, bool burst)
+    {
+        System system(sf::Vector2f{8.f, 8.f}, sf::Color::Green, defaultParticle());
+        system.reserve(count);
+        Emitter<PGreen> emitter(defaultParticle());
+        emitter.setParticleSystem(&system);
+        emitter.setPosition(center + sf::Vector2f{200.f, 0.f});
+        emitter.addModifier([](PGreen& particle, Emitter<PGreen>* emit) {
+            sf::Vector2f len = emit->getPosition() - center;
+            sf::Vector2f unit = len / std::sqrt(len.x * len.x + len.y * len.y);
+            Rng& rng = emit->getRng();
+            particle.position = emit->getPosition() + unit * rng.uniform(0.f, 150.f);
+            const float radius = rng.uniform(0.0001f, 0.000800f);
+            particle.radius = rng() & 1u ? -radius : radius;
+            emit->setPosition(rotate(len, .025f) + center);
+        });
+
+        //at most 500k particles per second, so that the steady scenarios span a few seconds of frames
+        const float rate = static_cast<float>(std::min<std::size_t>(count, 500000));
+        const sf::Time duration = sf::seconds(static_cast<float>(count) / rate);
+        emitter.setEmissionRate(rate);
+
+        //steady emission spreads the particles over 60fps frames, a burst emits all of them in one update
+        const std::size_t frames = burst ? 1 : static_cast<std::size_t>(std::ceil(duration / timePerFrame));
+        const sf::Time dt = burst ? duration : timePerFrame;
+        const double start = now();
+        for (std::size_t f = 0; f < frames; ++f)
+            emitter.update(dt + sf::microseconds(1));
+        const double elapsed = now() - start;
+        return elapsed / std::max<std::size_t>(system.getParticleCount(), 1);
+    }
+
+    Result measure(Scenario const& scenario, std::size_t count, Options const& options, ThreadPool* pool)
+    {
+        const std::size_t frames = framesFor(options, count);
+        Result result{scenario.name, count, 0.0, 0.0, 0.0, 0.0};
+
+        //aging alone: same population, no affectors
+        double aging = 0.0;
+        {
+            System system(sf::Vector2f{8.f, 8.f}, sf::Color::Green, defaultParticle());
+            system.setThreadPool(pool);
+            scenario.populate(system, count);
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                const double start = now();
+                system.update(timePerFrame);
+                aging += now() - start;
+            }
+        }
+
+        //the whole update with affectors, whose share the system measures itself, then the vertices of the same frames
+        double affectors = 0.0;
+        double vertices = 0.0;
+        {
+            System system(sf::Vector2f{8.f, 8.f}, sf::Color::Green, defaultParticle());
+            system.setThreadPool(pool);
+            scenario.populate(system, count);
+            scenario.affect(system);
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                system.update(timePerFrame);
+                affectors += system.getStats().affectors.asMicroseconds() * 1000.0;
+                const double start = now();
+                system.getVertices();
+                vertices += now() - start;
+            }
+        }
+
+        const double perParticle = static_cast<double>(frames) * static_cast<double>(count);
+        result.aging = aging / perParticle;
+        result.affectors = affectors / perParticle;
+        result.vertices = vertices / perParticle;
+        result.emission = measureEmission(count, scenario.name == "burst");
+        return result;
+    }
+
+    std::string toJson(std::vector<Result> const& results, Options const& options)
+    {
+        std::ostringstream out;
+        out << "{\n  \"version\": 1,\n  \"threads\": " << options.threads << ",\n  \"results\": [\n";
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            Result const& r = results[i];
+            out << "    {\"scenario\": \"" << r.scenario << "\", \"particles\": " << r.particles
+                << ", \"aging_ns\": " << r.aging << ", \"affectors_ns\": " << r.affectors
+                << ", \"vertices_ns\": " << r.vertices << ", \"emission_ns\": " << r.emission << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return out.str();
+    }
+
+    //reads back what toJson() writes; not a general JSON parser
+    std::vector<Result> fromJson(std::string const& text)
+    {
+        auto number = [](std::string const& object, std::string const& key) {
+            const std::size_t at = object.find("\"" + key + "\":");
+            return at == std::string::npos ? 0.0 : std::strtod(object.c_str() + at + key.size() + 3, nullptr);
+        };
+        std::vector<Result> results;
+        std::size_t at = 0;
+        while ((at = text.find("{\"scenario\"", at)) != std::string::npos)
+        {
+            const std::size_t end = text.find('}', at);
+            const std::string object = text.substr(at, end - at);
+            const std::size_t nameStart = object.find(": \"") + 3;
+            Result r;
+            r.scenario = object.substr(nameStart, object.find('"', nameStart) - nameStart);
+            r.particles = static_cast<std::size_t>(number(object, "particles"));
+            r.aging = number(object, "aging_ns");
+            r.affectors = number(object, "affectors_ns");
+            r.vertices = number(object, "vertices_ns");
+            r.emission = number(object, "emission_ns");
+            results.push_back(r);
+            at = end;
+        }
+        return results;
+    }
+
+    //prints every phase that regressed by more than the tolerance, returns how many did
+    int compare(std::vector<Result> const& results, std::vector<Result> const& baseline, double tolerance)
+    {
+        std::map<std::pair<std::string, std::size_t>, Result> byKey;
+        for (Result const& r : baseline)
+            byKey[{r.scenario, r.particles}] = r;
+
+        int regressions = 0;
+        for (Result const& r : results)
+        {
+            auto found = byKey.find({r.scenario, r.particles});
+            if (found == byKey.end())
+                continue;
+            Result const& b = found->second;
+            const std::pair<const char*, std::pair<double, double>> phases[] = {
+                {"aging", {r.aging, b.aging}},
+                {"affectors", {r.affectors, b.affectors}},
+                {"vertices", {r.vertices, b.vertices}},
+                {"emission", {r.emission, b.emission}},
+            };
+            for (auto const& phase : phases)
+            {
+                const double current = phase.second.first;
+                const double previous = phase.second.second;
+                //a phase that took no time at all before regressed by any time it takes now
+                if (current > previous * (1.0 + tolerance))
+                {
+                    std::cerr << "regression: " << r.scenario << " " << r.particles << " " << phase.first
+                              << " " << previous << " -> " << current << " ns/particle";
+                    if (previous > 0.0)
+                        std::cerr << " (" << static_cast<int>((current / previous - 1.0) * 100.0) << "%)";
+                    std::cerr << "\n";
+                    ++regressions;
+                }
+            }
+        }
+        return regressions;
+    }
+
+    Options parse(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const std::string flag = argv[i];
+            const std::string value = argv[i + 1];
+            if (flag == "--max")
+                options.maxParticles = std::stoull(value);
+            else if (flag == "--frames")
+                options.frames = std::stoull(value);
+            else if (flag == "--threads")
+                options.threads = static_cast<unsigned>(std::stoul(value));
+            else if (flag == "--seed")
+                options.seed = std::stoull(value);
+            else if (flag == "--scenario")
+                options.scenario = value;
+            else if (flag == "--out")
+                options.out = value;
+            else if (flag == "--baseline")
+                options.baseline = value;
+            else if (flag == "--tolerance")
+                options.tolerance = std::stod(value);
+            else
+                std::cerr << "unknown option " << flag << '\n';
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const Options options = parse(argc, argv);
+    rng::seed(options.seed);
+    ThreadPool pool(options.threads);
+
+    std::vector<Result> results;
+    for (Scenario const& scenario : scenarios)
+    {
+        if (!options.scenario.empty() && options.scenario != scenario.name)
+            continue;
+        for (std::size_t count = 1000; count <= options.maxParticles; count *= 10)
+        {
+            results.push_back(measure(scenario, count, options, options.threads ? &pool : nullptr));
+            Result const& r = results.back();
+            std::cerr << r.scenario << " " << r.particles << ": aging " << r.aging << " affectors " << r.affectors
+                      << " vertices " << r.vertices << " emission " << r.emission << " ns/particle\n";
+        }
+    }
+
+    std::ofstream(options.out) << toJson(results, options);
+
+    if (!options.baseline.empty())
+    {
+        std::ifstream file(options.baseline);
+        if (!file)
+        {
+            std::cerr << "can't read baseline " << options.baseline << '\n';
+            return 2;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        return compare(results, fromJson(text.str()), options.tolerance) ? 1 : 0;
+    }
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include <cmath>
 #include "ParticleSystem.hpp"
 #include "Emitter.hpp"
+#include "SimulationThread.hpp"
+#include "QualityController.hpp"
 #include "Utility.hpp"
 
 #include <SFML/Graphics/RenderWindow.hpp>
@@ -53,20 +55,22 @@ int main()
 
     // sys.addAffector([](std::deque<Particle>&){
     // });
-    auto affector = [defaultGreen, center = window.getView().getCenter()](std::deque<PGreen> &particleList) {
+    auto affector = [defaultGreen, center = window.getView().getCenter()](std::vector<PGreen> &particleList) {
         static int rotation = 0;
         rotation ++;
         const int maxRotation = 120; 
 
         float speed = particleList.size();
         speed /= 1000;
+        //every particle turns by the same angle, so cos/sin only need computing once per frame
+        const float angle = 0.01f * (speed + 1);
+        const sf::Vector2f turn{std::cos(angle), std::sin(angle)};
         for (auto &particle : particleList)
         {
             //rotation
             sf::Vector2f len = particle.position - center;
 
-            float angle = 0.01f * (speed + 1);
-            len = rotate(len, angle);
+            len = rotate(len, turn);
 
             /*double*/float variance = particle.radius;
 
@@ -128,6 +132,7 @@ int main()
 
     sys.addAffector(affector);
     //sys.addFinalizer(finalizer);
+    sys.setCulling(true, true); //the orbit throws plenty of particles past the edges of the window
 
     Emitter<PGreen> emit(defaultGreen);
     emit.setEmissionRate(500);
@@ -138,8 +143,10 @@ int main()
         const int BAND_RADIUS = 150;
         sf::Vector2f len = emit->getPosition() - center;
         sf::Vector2f unit = (len)/(std::sqrt(len.x * len.x + len.y * len.y));
-        particle.position = emit->getPosition() + unit * getRandom<float>(0.f, BAND_RADIUS);
-        particle.radius = getRandom(0,1) ? getRandom<double>(-0.000800, -0.0001) : getRandom<double>(0.0001, 0.000800);
+        Rng& rng = emit->getRng();
+        particle.position = emit->getPosition() + unit * rng.uniform(0.f, BAND_RADIUS);
+        const float radius = rng.uniform(0.0001f, 0.000800f);
+        particle.radius = rng() & 1u ? -radius : radius;
         emit->setPosition(rotate(len, .025f) + center);
     };
 
@@ -156,9 +163,22 @@ int main()
 
     bool running = true;
 
-    sf::Clock clock;
+    //the particles live on a thread of their own at a fixed 60 steps per second, the window only draws snapshots
     sf::Time timePerFrame = sf::seconds(1.f / 60);
-    sf::Time dt = sf::Time::Zero;
+    SimulationThread<PGreen> simulation(sys, timePerFrame);
+    //the ramp sets the rate at full quality; the controller scales it back (and thins the drawing) whenever a step costs more than 8ms
+    QualityController quality(sf::milliseconds(8));
+    const std::size_t orbit = quality.add(sys, &emit);
+    float rate = 500.f;
+    simulation.setStep([&emit, &quality, orbit, &rate](sf::Time dt) {
+        if(rate < 2400.f)
+            quality.setBaseEmissionRate(orbit, rate += .3f);
+        quality.update();
+        emit.update(dt);
+    });
+    simulation.setInterpolation(true);
+    simulation.start();
+
     while (running)
     {
         //logic handling
@@ -204,21 +224,14 @@ int main()
         // }
 
         //other logic
-        dt += clock.restart();
-        if (dt >= timePerFrame)
-        {
-            dt -= timePerFrame;
-            if(emit.getEmissionRate() < 2400.f)
-            emit.setEmissionRate((emit.getEmissionRate()+.3f));
-
-            emit.update(dt);
-            sys.update(timePerFrame);
-            stats.setString(std::to_string(sys.getParticleCount()));
-        }
+        const RenderSnapshot& snapshot = simulation.getSnapshot();
+        stats.setString(std::to_string(snapshot.particles) + " particles\n"
+            + "update " + std::to_string(snapshot.stats.aging.asMicroseconds() + snapshot.stats.affectors.asMicroseconds()) + "us\n"
+            + "vertices " + std::to_string(snapshot.stats.vertices.asMicroseconds()) + "us");
 
         window.clear();
         window.draw(stats);
-        window.draw(sys);
+        window.draw(simulation);
         window.display();
     }
 }